@@ -0,0 +1,42 @@
+#-------------------------------------------------
+#
+# Latency and jitter benchmark of DOController
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+TARGET = DOBenchmark
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+#   the controller is built in, the mock backend always runs and the
+#   device is measured too when the vendor driver finds it
+DEFINES += DOCONTROLLER_LIBRARY
+
+INCLUDEPATH += ../lib/common \
+    ../DOController
+
+SOURCES += main.cpp \
+    ../DOController/docontroller.cpp \
+    ../DOController/mockdobackend.cpp \
+    ../DOController/patternstore.cpp
+
+HEADERS += ../DOController/docontroller.h \
+    ../DOController/dobackend.h \
+    ../DOController/doerror.h \
+    ../DOController/mockdobackend.h \
+    ../DOController/patternstore.h
+
+#   qmake BENCH_LABEL=name puts name in the report, --label overrides it
+!isEmpty(BENCH_LABEL): DEFINES += DOBENCH_LABEL=\\\"$$BENCH_LABEL\\\"
+
+#   qmake CONFIG+=nobdaq measures the mock alone
+nobdaq {
+    DEFINES += DOCONTROLLER_NO_BDAQ
+} else {
+    SOURCES += ../DOController/bdaqbackend.cpp
+    HEADERS += ../DOController/bdaqbackend.h
+}
@@ -0,0 +1,328 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QVector>
+#include <QFile>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+#include <math.h>
+#include <algorithm>
+
+#include "docontroller.h"
+#include "mockdobackend.h"
+
+#define BENCH_ITERATIONS 1000
+#define BENCH_PATTERNS 100
+#define BENCH_PERIOD_US 1000
+#define BENCH_DWELL 4
+//  identifies the build in the report, qmake BENCH_LABEL=... or --label
+#ifndef DOBENCH_LABEL
+#define DOBENCH_LABEL ""
+#endif
+
+//  spins on a core to put the measured thread under load
+class Spinner : public QThread
+{
+public:
+    Spinner() : m_stop(0) {}
+    inline void stop() { m_stop.storeRelease(1); }
+
+protected:
+    void run()
+    {
+        volatile quint64 count = 0;
+        while (m_stop.loadAcquire() == 0)
+            count++;
+    }
+
+private:
+    QAtomicInt m_stop;
+};
+
+static qint64 percentile(const QVector<qint64>& sorted, double p)
+{
+    int index = qMin(sorted.size() - 1,(int)ceil(p * sorted.size()) - 1);
+    return sorted.at(qMax(index,0));
+}
+
+//  distribution of the samples in ns
+static QJsonObject statistics(QVector<qint64> samples)
+{
+    QJsonObject stats;
+    stats["count"] = samples.size();
+    if (samples.isEmpty())
+        return stats;
+
+    std::sort(samples.begin(),samples.end());
+    double sum = 0;
+    foreach (qint64 sample, samples)
+    {
+        sum += sample;
+    }
+    double mean = sum / samples.size();
+    double variance = 0;
+    foreach (qint64 sample, samples)
+    {
+        variance += (sample - mean) * (sample - mean);
+    }
+
+    stats["min"] = (double)samples.first();
+    stats["median"] = (double)percentile(samples,0.5);
+    stats["mean"] = mean;
+    stats["p90"] = (double)percentile(samples,0.9);
+    stats["p99"] = (double)percentile(samples,0.99);
+    stats["p999"] = (double)percentile(samples,0.999);
+    stats["max"] = (double)samples.last();
+    stats["stddev"] = sqrt(variance / samples.size());
+    return stats;
+}
+
+static QJsonObject benchmark(DOController& controller, int iterations, int patterns,
+                             int periodUs)
+{
+    QJsonObject calls;
+    QVector<qint64> samples;
+    samples.reserve(qMax(iterations,patterns));
+    QElapsedTimer timer;
+
+    //  alternate the values so that the shadow registers skip nothing
+    samples.clear();
+    for (int i=0;i<iterations;i++)
+    {
+        timer.start();
+        controller.writeData(PORT_CHANNEL,(quint8)(i & 1));
+        samples.append(timer.nsecsElapsed());
+    }
+    calls["writeData"] = statistics(samples);
+
+    samples.clear();
+    for (int i=0;i<iterations;i++)
+    {
+        timer.start();
+        controller.sendPhase((quint8)(i % TRANSDUCER_COUNT),(quint8)(i / TRANSDUCER_COUNT + 1));
+        samples.append(timer.nsecsElapsed());
+    }
+    calls["sendPhase"] = statistics(samples);
+
+    samples.clear();
+    for (int i=0;i<iterations;i++)
+    {
+        timer.start();
+        controller.loadPhase();
+        samples.append(timer.nsecsElapsed());
+    }
+    calls["loadPhase"] = statistics(samples);
+
+    //  every channel, then one changed channel per pattern
+    quint8 phases[TRANSDUCER_COUNT];
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        phases[channel] = (quint8)(channel * 7);
+    }
+    controller.setDifferentialUpload(false);
+    samples.clear();
+    for (int i=0;i<patterns;i++)
+    {
+        phases[i % TRANSDUCER_COUNT]++;
+        controller.loadPattern(phases);
+        samples.append(controller.lastUploadNs());
+    }
+    calls["loadPattern"] = statistics(samples);
+
+    controller.setDifferentialUpload(true);
+    samples.clear();
+    for (int i=0;i<patterns;i++)
+    {
+        phases[i % TRANSDUCER_COUNT]++;
+        controller.loadPattern(phases);
+        samples.append(controller.lastUploadNs());
+    }
+    calls["loadPatternDifferential"] = statistics(samples);
+
+    //  a raster plan dwelling BENCH_DWELL periods on each spot, held
+    //  once per spot in a PatternStore and loaded by handle
+    PatternStore store;
+    QVector<PatternHandle> plan(patterns);
+    for (int i=0;i<patterns;i++)
+    {
+        if (i % BENCH_DWELL == 0)
+            phases[(i / BENCH_DWELL) % TRANSDUCER_COUNT]++;
+        plan[i] = store.add(phases);
+    }
+    samples.clear();
+    for (int i=0;i<patterns;i++)
+    {
+        controller.loadPattern(store,plan.at(i));
+        samples.append(controller.lastUploadNs());
+    }
+    calls["loadPatternStore"] = statistics(samples);
+
+    if (controller.setBufferedMode(true))
+    {
+        controller.setDifferentialUpload(false);
+        samples.clear();
+        for (int i=0;i<patterns;i++)
+        {
+            phases[i % TRANSDUCER_COUNT]++;
+            controller.loadPattern(phases);
+            samples.append(controller.lastUploadNs());
+        }
+        calls["loadPatternBuffered"] = statistics(samples);
+        controller.setBufferedMode(false);
+        controller.setDifferentialUpload(true);
+    }
+
+    //  enable/disable on a fixed period: how long each toggle takes and
+    //  how far apart consecutive toggles really land
+    QVector<qint64> jitter;
+    jitter.reserve(iterations);
+    samples.clear();
+    qint64 periodNs = qint64(periodUs) * 1000;
+    qint64 previous = -1;
+    QElapsedTimer clock;
+    clock.start();
+    for (int i=0;i<iterations;i++)
+    {
+        qint64 target = (i + 1) * periodNs;
+        while (clock.nsecsElapsed() < target)
+        {
+        }
+        qint64 start = clock.nsecsElapsed();
+        if (i & 1)
+            controller.disable();
+        else
+            controller.enable();
+        qint64 done = clock.nsecsElapsed();
+        samples.append(done - start);
+        if (previous >= 0)
+            jitter.append(qAbs(done - previous - periodNs));
+        previous = done;
+    }
+    controller.disable();
+    calls["toggle"] = statistics(samples);
+    calls["toggleJitter"] = statistics(jitter);
+
+    QJsonObject counters;
+    counters["writesIssued"] = (double)controller.writesIssued();
+    counters["writesSkipped"] = (double)controller.writesSkipped();
+    counters["channelsSent"] = (double)controller.channelsSent();
+    counters["channelsSkipped"] = (double)controller.channelsSkipped();
+    counters["storePatterns"] = store.count();
+    counters["storeBytes"] = store.bytes();
+    calls["counters"] = counters;
+    return calls;
+}
+
+static int option(QStringList& args, const QString& name, int value)
+{
+    int index = args.indexOf(name);
+    if (index >= 0 && index + 1 < args.size())
+    {
+        value = args.at(index + 1).toInt();
+        args.removeAt(index + 1);
+        args.removeAt(index);
+    }
+    return value;
+}
+
+static QString option(QStringList& args, const QString& name, const QString& value)
+{
+    int index = args.indexOf(name);
+    if (index >= 0 && index + 1 < args.size())
+    {
+        QString text = args.at(index + 1);
+        args.removeAt(index + 1);
+        args.removeAt(index);
+        return text;
+    }
+    return value;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    QStringList args = a.arguments();
+    args.removeFirst();
+    bool mockOnly = args.removeAll("--mock") > 0;
+    int iterations = option(args,"--iterations",BENCH_ITERATIONS);
+    int patterns = option(args,"--patterns",BENCH_PATTERNS);
+    int periodUs = option(args,"--period",BENCH_PERIOD_US);
+    int latencyNs = option(args,"--mock-latency",0);
+    int load = option(args,"--load",0);
+    QString outName = option(args,"--out",QString());
+    QString label = option(args,"--label",QString(DOBENCH_LABEL));
+    if (!args.isEmpty() || iterations <= 0 || patterns <= 0 || periodUs <= 0)
+    {
+        out << "usage: DOBenchmark [--mock] [--iterations N] [--patterns N] [--period us]"
+            << " [--mock-latency ns] [--load threads] [--label build] [--out file.json]" << endl;
+        return 1;
+    }
+
+    QVector<Spinner*> spinners;
+    for (int i=0;i<load;i++)
+    {
+        spinners.append(new Spinner());
+        spinners.last()->start();
+    }
+
+    QJsonObject backends;
+    {
+        MockDOBackend *mock = new MockDOBackend(true);
+        mock->setCallLatencyNs(latencyNs);
+        mock->setRecording(false);
+        DOController controller(mock,0);
+        backends["mock"] = benchmark(controller,iterations,patterns,periodUs);
+    }
+#ifndef DOCONTROLLER_NO_BDAQ
+    if (!mockOnly)
+    {
+        DOController controller;
+        if (controller.exist())
+        {
+            backends["device"] = benchmark(controller,iterations,patterns,periodUs);
+        }
+    }
+#else
+    Q_UNUSED(mockOnly);
+#endif
+
+    foreach (Spinner* spinner, spinners)
+    {
+        spinner->stop();
+        spinner->wait();
+        delete spinner;
+    }
+
+    //  samples in ns; the settings are kept so that runs can be diffed
+    QJsonObject settings;
+    settings["iterations"] = iterations;
+    settings["patterns"] = patterns;
+    settings["periodUs"] = periodUs;
+    settings["mockLatencyNs"] = latencyNs;
+    settings["load"] = load;
+    QJsonObject report;
+    report["qt"] = QString(qVersion());
+    //  not the build time, two builds of the same tree give the same report
+    report["label"] = label;
+    report["settings"] = settings;
+    report["backends"] = backends;
+
+    QByteArray json = QJsonDocument(report).toJson();
+    if (outName.isEmpty())
+    {
+        out << json;
+        return 0;
+    }
+    QFile file(outName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size())
+    {
+        out << "Cannot write " << outName << endl;
+        return 1;
+    }
+    return 0;
+}
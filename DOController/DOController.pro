@@ -4,8 +4,8 @@
 #
 #-------------------------------------------------
 
+#   headless, errors are queued instead of shown, QtCore is all it links
 QT       -= gui
-QT       += widgets
 
 TARGET = DOController
 TEMPLATE = lib
@@ -14,10 +14,29 @@ DEFINES += DOCONTROLLER_LIBRARY
 
 INCLUDEPATH += ../lib/common
 
-SOURCES += docontroller.cpp
+SOURCES += docontroller.cpp \
+    mockdobackend.cpp \
+    doworker.cpp \
+    doboardarray.cpp \
+    patternstore.cpp
 
 HEADERS += docontroller.h\
-        docontroller_global.h
+        docontroller_global.h \
+    dobackend.h \
+    doerror.h \
+    doworker.h \
+    doboardarray.h \
+    patternstore.h \
+    mockdobackend.h
+
+#   qmake CONFIG+=nobdaq builds without the vendor driver,
+#   DOController then runs on MockDOBackend
+nobdaq {
+    DEFINES += DOCONTROLLER_NO_BDAQ
+} else {
+    SOURCES += bdaqbackend.cpp
+    HEADERS += bdaqbackend.h
+}
 
 unix {
     target.path = /usr/lib
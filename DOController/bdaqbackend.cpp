@@ -0,0 +1,122 @@
+#include <QThread>
+
+#include "bdaqbackend.h"
+#include "constant.h"
+
+BDaqBackend::BDaqBackend() :
+    m_removedListener(this),
+    m_reconnectedListener(this),
+    m_instantDoCtrl(NULL),
+    m_bufferedDoCtrl(NULL)
+{
+}
+
+BDaqBackend::~BDaqBackend()
+{
+    close();
+}
+
+void BDaqBackend::close()
+{
+    if (m_instantDoCtrl != NULL)
+    {
+        m_instantDoCtrl->removeRemovedListener(m_removedListener);
+        m_instantDoCtrl->removeReconnectedListener(m_reconnectedListener);
+        m_instantDoCtrl->Dispose();
+        m_instantDoCtrl = NULL;
+    }
+    if (m_bufferedDoCtrl != NULL)
+    {
+        m_bufferedDoCtrl->Dispose();
+        m_bufferedDoCtrl = NULL;
+    }
+}
+
+DOErrorCode BDaqBackend::open(const QString &deviceName)
+{
+    close();
+
+    std::wstring description = deviceName.toStdWString();
+    DeviceInformation selected(description.c_str());
+    m_instantDoCtrl = AdxInstantDoCtrlCreate();
+
+    ErrorCode errorCode = Success;
+    errorCode = m_instantDoCtrl->setSelectedDevice(selected);
+    if (errorCode == ErrorDeviceNotExist)
+    {
+        m_instantDoCtrl->Dispose();
+        m_instantDoCtrl = NULL;
+    }
+
+    if (isOpen())
+    {
+        m_instantDoCtrl->addRemovedListener(m_removedListener);
+        m_instantDoCtrl->addReconnectedListener(m_reconnectedListener);
+        openBuffered(selected);
+    }
+    return (DOErrorCode)errorCode;
+}
+
+void BDaqBackend::openBuffered(const DeviceInformation &selected)
+{
+    //  a device without buffered DO is not an error, DOController
+    //  stays on the instant path
+    m_bufferedDoCtrl = AdxBufferedDoCtrlCreate();
+    if (m_bufferedDoCtrl == NULL)
+        return;
+
+    if (m_bufferedDoCtrl->setSelectedDevice(selected) != Success ||
+        !m_bufferedDoCtrl->getFeatures()->getBufferedDoSupported())
+    {
+        m_bufferedDoCtrl->Dispose();
+        m_bufferedDoCtrl = NULL;
+    }
+}
+
+DOErrorCode BDaqBackend::writePorts(int portStart, int portCount, const quint8 states[])
+{
+    return (DOErrorCode)m_instantDoCtrl->WriteAny(portStart,portCount,const_cast<quint8*>(states));
+}
+
+DOErrorCode BDaqBackend::readPorts(int portStart, int portCount, quint8 states[])
+{
+    return (DOErrorCode)m_instantDoCtrl->ReadAny(portStart,portCount,states);
+}
+
+DOErrorCode BDaqBackend::streamPorts(int portStart, int portCount,
+                                     const quint8 samples[], int sampleCount,
+                                     double rate, const Deadline &deadline)
+{
+    if (!bufferedSupported())
+        return DO_CODE_FUNC_NOT_SUPPORTED;
+
+    ErrorCode errorCode = Success;
+    ScanPort *scanPort = m_bufferedDoCtrl->getScanPort();
+    errorCode = scanPort->setPortStart(portStart);
+    errorCode = (errorCode == Success) ? scanPort->setPortCount(portCount) : errorCode;
+    errorCode = (errorCode == Success) ? scanPort->setSamples(sampleCount) : errorCode;
+    ConvertClock *convertClock = m_bufferedDoCtrl->getConvertClock();
+    errorCode = (errorCode == Success) ? convertClock->setSource(SigInternalClock) : errorCode;
+    errorCode = (errorCode == Success) ? convertClock->setRate(rate) : errorCode;
+    errorCode = (errorCode == Success) ? m_bufferedDoCtrl->setStreaming(false) : errorCode;
+    errorCode = (errorCode == Success) ? m_bufferedDoCtrl->Prepare() : errorCode;
+    errorCode = (errorCode == Success) ?
+                m_bufferedDoCtrl->SetData(sampleCount * portCount,const_cast<quint8*>(samples)) :
+                errorCode;
+    errorCode = (errorCode == Success) ? m_bufferedDoCtrl->Start() : errorCode;
+    if (errorCode != Success)
+        return (DOErrorCode)errorCode;
+
+    //  bounded by the sample clock, the margin only guards a stuck device
+    Deadline clocked((int)(sampleCount * MS_UNIT / rate) + DO_STREAM_MARGIN);
+    while (m_bufferedDoCtrl->getState() == Running)
+    {
+        if (deadline.reached() || clocked.expired())
+        {
+            m_bufferedDoCtrl->Stop(0);
+            return DO_CODE_IO_TIMEOUT;
+        }
+        QThread::yieldCurrentThread();
+    }
+    return DO_SUCCESS;
+}
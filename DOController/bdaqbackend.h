@@ -0,0 +1,65 @@
+#ifndef BDAQBACKEND_H
+#define BDAQBACKEND_H
+
+#include "dobackend.h"
+#include "Inc/bdaqctrl.h"
+
+using namespace Automation::BDaq;
+
+//  DOBackend on the Advantech BDaq driver, InstantDoCtrl for port access
+//  and BufferedDoCtrl for streaming when the device supports it
+class DOCONTROLLERSHARED_EXPORT BDaqBackend : public DOBackend
+{
+public:
+    BDaqBackend();
+    ~BDaqBackend();
+
+    DOErrorCode open(const QString& deviceName);
+    inline bool isOpen() const { return m_instantDoCtrl != NULL; }
+
+    DOErrorCode writePorts(int portStart, int portCount, const quint8 states[]);
+    DOErrorCode readPorts(int portStart, int portCount, quint8 states[]);
+
+    inline bool bufferedSupported() const { return m_bufferedDoCtrl != NULL; }
+    DOErrorCode streamPorts(int portStart, int portCount,
+                            const quint8 samples[], int sampleCount,
+                            double rate, const Deadline& deadline);
+
+private:
+    //  the driver calls back on its own thread, only the counters move
+    class RemovedListener : public DeviceEventListener
+    {
+    public:
+        RemovedListener(BDaqBackend *backend) : m_backend(backend) {}
+        void BDAQCALL DeviceEvent(void *sender, DeviceEventArgs *args)
+        {
+            Q_UNUSED(sender);
+            Q_UNUSED(args);
+            m_backend->notifyRemoved();
+        }
+    private:
+        BDaqBackend *m_backend;
+    };
+    class ReconnectedListener : public DeviceEventListener
+    {
+    public:
+        ReconnectedListener(BDaqBackend *backend) : m_backend(backend) {}
+        void BDAQCALL DeviceEvent(void *sender, DeviceEventArgs *args)
+        {
+            Q_UNUSED(sender);
+            Q_UNUSED(args);
+            m_backend->notifyReconnected();
+        }
+    private:
+        BDaqBackend *m_backend;
+    };
+
+    RemovedListener m_removedListener;
+    ReconnectedListener m_reconnectedListener;
+    InstantDoCtrl *m_instantDoCtrl;
+    BufferedDoCtrl *m_bufferedDoCtrl;
+    void close();
+    void openBuffered(const DeviceInformation& selected);
+};
+
+#endif // BDAQBACKEND_H
@@ -0,0 +1,48 @@
+#ifndef DOBACKEND_H
+#define DOBACKEND_H
+
+#include <QString>
+#include <QAtomicInt>
+
+#include "docontroller_global.h"
+#include "doerror.h"
+#include "deadline.h"
+
+//  Access to the digital output ports used by DOController.
+//  Errors are reported as DOErrorCode whatever the backend.
+class DOCONTROLLERSHARED_EXPORT DOBackend
+{
+public:
+    DOBackend() : m_removals(0), m_reconnections(0) {}
+    virtual ~DOBackend() {}
+
+    //  select the device by its description, e.g. DEVICE_ID
+    virtual DOErrorCode open(const QString& deviceName) = 0;
+    virtual bool isOpen() const = 0;
+
+    virtual DOErrorCode writePorts(int portStart, int portCount, const quint8 states[]) = 0;
+    virtual DOErrorCode readPorts(int portStart, int portCount, quint8 states[]) = 0;
+
+    //  clock sampleCount samples of portCount ports out at rate samples/s,
+    //  blocks until the buffer is out or the deadline is reached
+    virtual bool bufferedSupported() const = 0;
+    virtual DOErrorCode streamPorts(int portStart, int portCount,
+                                    const quint8 samples[], int sampleCount,
+                                    double rate, const Deadline& deadline) = 0;
+
+    //  hot-plug events, counted from whatever thread the driver uses;
+    //  the device is gone while removals() is ahead of reconnections()
+    inline int removals() const { return m_removals.loadAcquire(); }
+    inline int reconnections() const { return m_reconnections.loadAcquire(); }
+    inline bool removed() const { return removals() != reconnections(); }
+
+protected:
+    inline void notifyRemoved() { m_removals.ref(); }
+    inline void notifyReconnected() { m_reconnections.ref(); }
+
+private:
+    QAtomicInt m_removals;
+    QAtomicInt m_reconnections;
+};
+
+#endif // DOBACKEND_H
@@ -0,0 +1,254 @@
+#include <QSettings>
+
+#include <string.h>
+
+#include "doboardarray.h"
+#include "macro.h"
+
+DOBoardArray::DOBoardArray(QObject *parent) : QObject(parent),
+    m_boardCount(0),
+    m_channelCount(0),
+    m_gate(DO_GATE_CLOSED),
+    m_skewNs(0),
+    m_uploadNs(0),
+    m_latchNs(0),
+    m_latched(false)
+{
+    memset(m_commits,0,sizeof(m_commits));
+    m_clock.start();
+}
+
+DOBoardArray::~DOBoardArray()
+{
+    clear();
+}
+
+void DOBoardArray::clear()
+{
+    for (int i=0;i<m_boardCount;i++)
+    {
+        delete m_boards[i].worker;
+    }
+    m_boardCount = 0;
+    m_channelCount = 0;
+    memset(m_commits,0,sizeof(m_commits));
+}
+
+void DOBoardArray::readSettings()
+{
+    clear();
+    QSettings* settings = new QSettings(SETTINGS_PATH,QSettings::IniFormat);
+    int size = settings->beginReadArray("DOBoards");
+    for (int i=0;i<size;i++)
+    {
+        settings->setArrayIndex(i);
+        QString device = settings->value("device",DEVICE_ID).toString();
+        int first = settings->value("first",i * TRANSDUCER_COUNT).toInt();
+        int count = settings->value("count",TRANSDUCER_COUNT).toInt();
+        DOController *controller = new DOController(device);
+        if (!addBoard(controller,first,count))
+        {
+            delete controller;
+        }
+    }
+    settings->endArray();
+    delete settings;
+
+    //  without the section the array is the single board it used to be
+    if (size == 0)
+    {
+        addBoard(new DOController(QString(DEVICE_ID)),0);
+    }
+}
+
+bool DOBoardArray::addBoard(DOController *controller, int first, int count)
+{
+    if (m_boardCount == DO_BOARD_MAX || first < 0 || count <= 0 || count > TRANSDUCER_COUNT)
+        return false;
+    for (int i=0;i<m_boardCount;i++)
+    {
+        const DOBoard& board = m_boards[i];
+        if (first < board.first + board.count && board.first < first + count)
+            return false;
+    }
+
+    DOBoard& board = m_boards[m_boardCount];
+    board.worker = new DOWorker(controller);
+    board.first = first;
+    board.count = count;
+    memcpy(board.phases,controller->latchedPattern(),TRANSDUCER_COUNT);
+    board.latchNs = 0;
+    board.verifyMask = 0;
+    board.verifySequence = 0;
+    board.worker->start();
+
+    m_boardCount++;
+    m_channelCount = qMax(m_channelCount,first + count);
+    return true;
+}
+
+bool DOBoardArray::waitAll(const quint32 sequences[], const Deadline &deadline,
+                           DOCompletion completions[])
+{
+    bool done = true;
+    for (int i=0;i<m_boardCount;i++)
+    {
+        DOWorker *worker = m_boards[i].worker;
+        completions[i].sequence = 0;
+        completions[i].result = 0;
+        completions[i].stampNs = 0;
+        if (sequences[i] == 0 || !worker->waitFor(sequences[i],deadline.remaining()))
+        {
+            done = false;
+            continue;
+        }
+        drain(i,sequences[i],&completions[i]);
+    }
+    return done;
+}
+
+bool DOBoardArray::drain(int index, quint32 sequence, DOCompletion *match)
+{
+    DOBoard& board = m_boards[index];
+    DOCompletion completion;
+    while (board.worker->drainCompletions(&completion,1) == 1)
+    {
+        //  a readback carries the sequence of its latch, it is never the match
+        if (completion.type == DO_CMD_VERIFY)
+        {
+            board.verifyMask = completion.result;
+            board.verifySequence = completion.sequence;
+        }else if (match != 0 && completion.sequence == sequence)
+        {
+            *match = completion;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DOBoardArray::setVerifyAfterLatch(bool verify)
+{
+    for (int i=0;i<m_boardCount;i++)
+    {
+        m_boards[i].worker->setVerifyAfterLatch(verify);
+    }
+}
+
+int DOBoardArray::pollVerify()
+{
+    int mismatched = 0;
+    for (int i=0;i<m_boardCount;i++)
+    {
+        drain(i,0,0);
+        mismatched += (m_boards[i].verifyMask != 0);
+    }
+    return mismatched;
+}
+
+int DOBoardArray::loadPattern(const quint8 phases[], int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    quint32 sequences[DO_BOARD_MAX];
+    DOCompletion completions[DO_BOARD_MAX];
+    for (int i=0;i<m_boardCount;i++)
+    {
+        DOBoard& board = m_boards[i];
+        memcpy(board.phases,phases + board.first,board.count);
+        sequences[i] = board.worker->stagePattern(board.phases,timeout);
+    }
+    //  each worker stops its upload at the timeout on its own
+    bool done = waitAll(sequences,Deadline(timeout < 0 ? DO_ARRAY_TIMEOUT :
+                                           timeout + DO_ARRAY_TIMEOUT),completions);
+
+    int channel = 0;
+    bool staged = done;
+    for (int i=0;i<m_boardCount;i++)
+    {
+        int written = qMin(completions[i].result,m_boards[i].count);
+        channel += written;
+        staged = staged && (completions[i].result == TRANSDUCER_COUNT);
+    }
+    m_uploadNs = timer.nsecsElapsed();
+
+    //  a board short of its slice keeps every board on the old pattern
+    m_latched = staged && latchAll();
+    return channel;
+}
+
+bool DOBoardArray::latchAll()
+{
+    //  a commit of the last latch still queued would take the gate of
+    //  this one for its own
+    for (int i=0;i<m_boardCount;i++)
+    {
+        if (m_commits[i] != 0 && !m_boards[i].worker->isDone(m_commits[i]))
+            return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    m_gate.storeRelease(DO_GATE_CLOSED);
+    m_arrived.tryAcquire(m_arrived.available());
+    for (int i=0;i<m_boardCount;i++)
+    {
+        m_commits[i] = m_boards[i].worker->commitAt(&m_gate,&m_arrived,&m_clock);
+    }
+
+    //  asleep until every board spins at the gate, then open it; a board
+    //  that never shows up makes all of them drop the commit
+    bool arrived = m_arrived.tryAcquire(m_boardCount,DO_LATCH_ARRIVAL);
+    m_gate.storeRelease(arrived ? DO_GATE_OPEN : DO_GATE_ABORT);
+
+    DOCompletion completions[DO_BOARD_MAX];
+    bool success = waitAll(m_commits,Deadline(DO_ARRAY_TIMEOUT),completions) && arrived;
+    qint64 earliest = 0;
+    qint64 latest = 0;
+    for (int i=0;i<m_boardCount;i++)
+    {
+        success = success && (completions[i].result == 1);
+        qint64 stamp = completions[i].stampNs;
+        m_boards[i].latchNs = stamp;
+        earliest = (i == 0) ? stamp : qMin(earliest,stamp);
+        latest = (i == 0) ? stamp : qMax(latest,stamp);
+    }
+    m_latchNs = timer.nsecsElapsed();
+
+    if (success)
+    {
+        m_skewNs = latest - earliest;
+        emit latched(m_skewNs);
+    }
+    return success;
+}
+
+bool DOBoardArray::broadcast(DOCOMMAND type)
+{
+    quint32 sequences[DO_BOARD_MAX];
+    DOCompletion completions[DO_BOARD_MAX];
+    for (int i=0;i<m_boardCount;i++)
+    {
+        DOWorker *worker = m_boards[i].worker;
+        sequences[i] = (type == DO_CMD_ENABLE) ? worker->enable() : worker->disable();
+    }
+
+    bool success = waitAll(sequences,Deadline(DO_ARRAY_TIMEOUT),completions);
+    for (int i=0;i<m_boardCount;i++)
+    {
+        success = success && (completions[i].result == 1);
+    }
+    return success;
+}
+
+bool DOBoardArray::enable()
+{
+    return broadcast(DO_CMD_ENABLE);
+}
+
+bool DOBoardArray::disable()
+{
+    return broadcast(DO_CMD_DISABLE);
+}
@@ -0,0 +1,109 @@
+#ifndef DOBOARDARRAY_H
+#define DOBOARDARRAY_H
+
+#include <QObject>
+#include <QSemaphore>
+#include <QElapsedTimer>
+
+#include "doworker.h"
+
+//  ms for all the boards to reach the latch gate
+#define DO_LATCH_ARRIVAL 100
+//  ms any wait on the boards may take on top of the upload timeout, a
+//  board still busy after it counts as failed
+#define DO_ARRAY_TIMEOUT 2000
+
+//  one board and the channels of the array it drives
+typedef struct DOBoard
+{
+    DOWorker* worker;
+    //  first array channel on board channel 0
+    int first;
+    int count;
+    //  what the board was last staged with, channels past count stay put
+    quint8 phases[TRANSDUCER_COUNT];
+    qint64 latchNs;
+    //  the last verify the worker ran after a latch, and that latch
+    int verifyMask;
+    quint32 verifySequence;
+}_DOBoard;
+
+//  Drives an array larger than one USB-4751. Every board uploads its
+//  slice of the pattern on its own worker thread; the boards then wait
+//  at a gate and strobe together once all of them are there. The spread
+//  of their load bit writes is reported as the latch skew. The boards
+//  belong to their workers, they are not handed out.
+class DOCONTROLLERSHARED_EXPORT DOBoardArray : public QObject
+{
+    Q_OBJECT
+
+public:
+    DOBoardArray(QObject *parent = 0);
+    ~DOBoardArray();
+
+    //  [DOBoards] in the settings, one entry per board:
+    //  device, first channel and channel count
+    void readSettings();
+    //  takes ownership of controller, returns false on an overlapping
+    //  or oversized range or with DO_BOARD_MAX boards already
+    bool addBoard(DOController *controller, int first, int count = TRANSDUCER_COUNT);
+    void clear();
+
+    inline int boardCount() const { return m_boardCount; }
+    //  array channels, the highest first + count over the boards
+    inline int channelCount() const { return m_channelCount; }
+
+    //  stage phases[first ~ first+count-1] on every board in parallel, then
+    //  latch them all; returns the channels written, the pattern is latched
+    //  only if every board has its slice before the deadline
+    int loadPattern(const quint8 phases[], int timeout = DEADLINE_NONE);
+    inline bool lastLatched() const { return m_latched; }
+    bool enable();
+    bool disable();
+
+    //  every worker reads its board back once a latch is out, see
+    //  DOWorker::setVerifyAfterLatch()
+    void setVerifyAfterLatch(bool verify);
+    //  DOController::verify() of the last readback of board index after
+    //  a latch, and the sequence of that latch on its worker. The readback
+    //  completes after the latch, it is taken in by the next wait on the
+    //  boards or by pollVerify()
+    inline int lastVerifyMask(int index) const { return m_boards[index].verifyMask; }
+    inline quint32 lastVerifySequence(int index) const { return m_boards[index].verifySequence; }
+    //  takes in the completed readbacks without waiting, returns the
+    //  boards whose last one found a mismatch or failed
+    int pollVerify();
+
+    //  latest minus earliest strobe of the last latch
+    inline qint64 lastSkewNs() const { return m_skewNs; }
+    inline qint64 latchNs(int index) const { return m_boards[index].latchNs; }
+    inline qint64 lastUploadNs() const { return m_uploadNs; }
+    inline qint64 lastLatchNs() const { return m_latchNs; }
+
+signals:
+    void latched(qint64 skewNs);
+
+private:
+    DOBoard m_boards[DO_BOARD_MAX];
+    int m_boardCount;
+    int m_channelCount;
+    QAtomicInt m_gate;
+    QSemaphore m_arrived;
+    //  gated commits of the last latch, the gate is not reused before
+    //  every one of them is done
+    quint32 m_commits[DO_BOARD_MAX];
+    QElapsedTimer m_clock;
+    qint64 m_skewNs;
+    qint64 m_uploadNs;
+    qint64 m_latchNs;
+    bool m_latched;
+    bool waitAll(const quint32 sequences[], const Deadline& deadline,
+                 DOCompletion completions[]);
+    //  the completions of board index up to the one of sequence, which
+    //  goes to match; readbacks are kept, the rest is of no interest
+    bool drain(int index, quint32 sequence, DOCompletion *match);
+    bool broadcast(DOCOMMAND type);
+    bool latchAll();
+};
+
+#endif // DOBOARDARRAY_H
@@ -1,70 +1,589 @@
-#include <QMessageBox>
+#include <QElapsedTimer>
+
+#include <string.h>
 
 #include "docontroller.h"
+#include "mockdobackend.h"
+#ifndef DOCONTROLLER_NO_BDAQ
+#include "bdaqbackend.h"
+#endif
 
 DOController::DOController(QObject *parent) : QObject(parent),
+#ifdef DOCONTROLLER_NO_BDAQ
+    m_backend(new MockDOBackend()),
+#else
+    m_backend(new BDaqBackend()),
+#endif
     m_deviceName(DEVICE_ID)
 {
-    selectDevice(m_deviceName);
+    initialize();
+}
+
+DOController::DOController(DOBackend *backend, QObject *parent) : QObject(parent),
+    m_backend(backend),
+    m_deviceName(DEVICE_ID)
+{
+    initialize();
+}
+
+DOController::DOController(const QString &deviceName, QObject *parent) : QObject(parent),
+#ifdef DOCONTROLLER_NO_BDAQ
+    m_backend(new MockDOBackend()),
+#else
+    m_backend(new BDaqBackend()),
+#endif
+    m_deviceName(deviceName)
+{
+    initialize();
 }
 
 DOController::~DOController()
 {
+    delete m_backend;
+}
+
+void DOController::initialize()
+{
+    m_uploadNs = 0;
+    m_buffered = false;
+    m_shadowValid = 0;
+    m_writesIssued = 0;
+    m_writesSkipped = 0;
+    m_reconnections = m_backend->reconnections();
+    m_recoveries = 0;
+    m_recoveryNs = 0;
+    m_verifyCount = 0;
+    m_verifyMismatches = 0;
+    m_verifyMask = 0;
+    m_differential = true;
+    m_channelsSent = 0;
+    m_channelsSkipped = 0;
+    m_latchOnStrobe = true;
+    m_latchedStore = 0;
+    m_latchedGeneration = 0;
+    m_latchedHandle = PATTERN_HANDLE_NONE;
+    m_stagedReady = false;
+    m_commitNs = 0;
+    m_strobeClock = 0;
+    m_strobeNs = 0;
+    m_errorPolicy = DO_POLICY_RETRY;
+    m_errorRetries = DO_ERROR_RETRIES;
+    m_aborted = false;
+    m_clock.start();
+    memset(m_shadow,0,sizeof(m_shadow));
+    memset(m_phase,0,sizeof(m_phase));
+    memset(m_latched,0,sizeof(m_latched));
+    selectDevice(m_deviceName);
+}
+
+void DOController::selectDevice(QString deviceName)
+{
+    DOErrorCode errorCode = DO_SUCCESS;
+    errorCode = m_backend->open(deviceName);
+    checkError(errorCode);
+    if (errorCode != DO_SUCCESS)
+    {
+        //  only on selecting the device, never on the write path
+        emit error("0x" + QString::number(errorCode, 16).right(8));
+    }
+
     if (exist())
     {
-        m_instantDoCtrl->Dispose();
+        readShadow();
     }
 }
 
-void DOController::selectDevice(QString deviceName)
+bool DOController::setBufferedMode(bool buffered)
 {
-    std::wstring description = deviceName.toStdWString();
-    DeviceInformation selected(description.c_str());
-    m_instantDoCtrl = AdxInstantDoCtrlCreate();
-
-    ErrorCode errorCode = Success;
-    errorCode = m_instantDoCtrl->setSelectedDevice(selected);
-    m_instantDoCtrl = ((errorCode == ErrorDeviceNotExist) ? NULL : m_instantDoCtrl);
-//    if (errorCode == ErrorDeviceNotExist)
-//    {
-//        m_instantDoCtrl = NULL;
-//    }
-    checkError(errorCode);
+    m_buffered = buffered && bufferedSupported();
+    return m_buffered == buffered;
+}
+
+void DOController::setErrorPolicy(DOERRORPOLICY policy, int retries)
+{
+    m_errorPolicy = policy;
+    m_errorRetries = qMax(0,retries);
+}
+
+void DOController::checkError(DOErrorCode errorCode, int port, int attempts)
+{
+    if (errorCode != DO_SUCCESS)
+    {
+        pushError(doErrorType(errorCode),(quint32)errorCode,port,attempts);
+
+        //  only DO_POLICY_CONTINUE lets a pattern with a failed channel latch
+        if (m_errorPolicy != DO_POLICY_CONTINUE)
+        {
+            m_aborted = true;
+        }
+    }
+}
+
+void DOController::pushError(DOERROR type, quint32 code, int port, int attempts)
+{
+    m_errorCount[type].ref();
+
+    DOErrorRecord record;
+    record.timestampNs = m_clock.nsecsElapsed();
+    record.code = code;
+    record.type = (quint8)type;
+    record.port = (qint8)port;
+    record.attempts = (quint8)qMin(attempts,255);
+    record.reserved = 0;
+    //  a full ring keeps the oldest errors, the newest are only counted
+    if (!m_errors.push(record))
+    {
+        m_errorsDropped.ref();
+    }
+}
+
+int DOController::drainErrors(DOErrorRecord records[], int max)
+{
+    int count = 0;
+    while (count < max && m_errors.pop(records[count]))
+        count++;
+    return count;
+}
+
+void DOController::readShadow()
+{
+    //  seed the shadow registers with what the device currently outputs
+    quint8 states[DO_PORT_COUNT];
+    m_shadowValid = 0;
+    if (m_backend->readPorts(0,DO_PORT_COUNT,states) == DO_SUCCESS)
+    {
+        for (int port=0;port<DO_PORT_COUNT;port++)
+        {
+            m_shadow[port] = states[port];
+        }
+        m_shadowValid = (1 << DO_PORT_COUNT) - 1;
+    }
+}
+
+bool DOController::pollDevice()
+{
+    int reconnections = m_backend->reconnections();
+    if (reconnections == m_reconnections)
+        return false;
+    m_reconnections = reconnections;
+    return recover();
 }
 
-void DOController::checkError(ErrorCode errorCode)
+bool DOController::recover()
 {
-    if (errorCode != Success)
+    QElapsedTimer timer;
+    timer.start();
+
+    //  what the board had before it went away
+    quint8 shadow[DO_PORT_COUNT];
+    quint32 shadowValid = m_shadowValid;
+    quint8 latched[TRANSDUCER_COUNT];
+    bool latchedKnown = m_latchedKnown.all();
+    memcpy(shadow,m_shadow,sizeof(shadow));
+    memcpy(latched,m_latched,sizeof(latched));
+
+    DOErrorCode errorCode = DO_SUCCESS;
+    errorCode = m_backend->open(m_deviceName);
+    checkError(errorCode);
+    bool success = (errorCode == DO_SUCCESS && exist());
+    if (success)
     {
-        QString message = "Sorry, there are some errors occurred, Error Code: 0x" +
-            QString::number(errorCode, 16).right(8);
-        QMessageBox::information(NULL,"Warning Information", message,QMessageBox::Ok);
-        QString errorString = "0x" + QString::number(errorCode, 16).right(8);
-        emit error(errorString);
+        //  the ports as the device powered up
+        readShadow();
+        writeBits(PORT_ENABLE,MASK_ENABLE,BYTE_DISABLE);
+
+        //  phases staged on the board are gone, those held back for
+        //  commit() are still here; a pattern never fully latched is not
+        //  put back half made of zeros
+        invalidatePattern();
+        m_stagedReady = m_stagedReady && !m_latchOnStrobe;
+        if (latchedKnown)
+            success = (uploadPattern(latched,Deadline(),true) == TRANSDUCER_COUNT);
+
+        //  every port back but the enable bit, the outputs stay off
+        //  until someone calls enable()
+        for (int port=0;port<DO_PORT_COUNT;port++)
+        {
+            if (!(shadowValid & (1 << port)))
+                shadow[port] = m_shadow[port];
+        }
+        shadow[PORT_ENABLE] = (shadow[PORT_ENABLE] & ~MASK_ENABLE) | (BYTE_DISABLE & MASK_ENABLE);
+        success = writeData(0,DO_PORT_COUNT,shadow) && success;
     }
+
+    m_recoveries++;
+    m_recoveryNs = timer.nsecsElapsed();
+    emit recovered(success);
+    return success;
 }
 
-void DOController::writeData(int port, quint8 state)
+int DOController::verify()
 {
-    ErrorCode errorCode = Success;
-    errorCode = m_instantDoCtrl->Write(port, state);
+    quint8 states[DO_PORT_COUNT];
+    DOErrorCode errorCode = DO_SUCCESS;
+    errorCode = m_backend->readPorts(0,DO_PORT_COUNT,states);
     checkError(errorCode);
+    if (errorCode != DO_SUCCESS)
+        return -1;
+
+    int mask = 0;
+    for (int port=0;port<DO_PORT_COUNT;port++)
+    {
+        if (!(m_shadowValid & (1 << port)) || m_shadow[port] == states[port])
+            continue;
+
+        mask |= 1 << port;
+        pushError(DO_ERROR_READBACK,(quint32)(m_shadow[port] << 8 | states[port]),port);
+        setShadow(port,states[port],true);
+    }
+
+    m_verifyCount++;
+    if (mask != 0)
+    {
+        m_verifyMismatches++;
+        //  a channel or phase port that did not take may have left a
+        //  channel wrong, the next upload sends them all
+        if (mask & (1 << PORT_CHANNEL | 1 << PORT_PHASE))
+        {
+            invalidatePattern();
+        }
+    }
+    m_verifyMask = mask;
+    return mask;
+}
+
+bool DOController::writeData(int port, quint8 state)
+{
+    return writeData(port,1,&state);
+}
+
+bool DOController::writeData(int portStart, int portCount, quint8 states[])
+{
+    //  leave out the ports at both ends that would not change
+    int first = 0;
+    int last = portCount - 1;
+    while (first <= last && shadowed(portStart + first,states[first]))
+        first++;
+    while (last >= first && shadowed(portStart + last,states[last]))
+        last--;
+    if (first > last)
+    {
+        m_writesSkipped++;
+        return true;
+    }
+
+    DOErrorCode errorCode = DO_SUCCESS;
+    int attempts = 0;
+    do
+    {
+        errorCode = m_backend->writePorts(portStart + first, last - first + 1, states + first);
+        m_writesIssued++;
+        attempts++;
+    } while (errorCode != DO_SUCCESS && m_errorPolicy == DO_POLICY_RETRY &&
+             attempts <= m_errorRetries);
+    for (int i=first;i<=last;i++)
+    {
+        setShadow(portStart + i,states[i],errorCode == DO_SUCCESS);
+    }
+    checkError(errorCode,portStart + first,attempts);
+    return errorCode == DO_SUCCESS;
+}
+
+bool DOController::writeBits(int port, quint8 mask, quint8 bits)
+{
+    quint8 state = (shadow(port) & ~mask) | (bits & mask);
+    return writeData(port,state);
+}
+
+void DOController::setShadow(int port, quint8 state, bool valid)
+{
+    if (0 <= port && port < DO_PORT_COUNT)
+    {
+        m_shadow[port] = state;
+        m_shadowValid = valid ? (m_shadowValid | (1 << port)) : (m_shadowValid & ~(1 << port));
+    }
 }
 
-void DOController::sendPhase(quint8 channel, quint8 phase)
+//  channel and phase are adjacent ports, one WriteAny sets both
+Q_STATIC_ASSERT(PORT_PHASE == PORT_CHANNEL + 1);
+
+bool DOController::sendPhase(quint8 channel, quint8 phase)
 {
-    writeData(PORT_CHANNEL,channel);
-    writeData(PORT_PHASE,phase);
+//    writeData(PORT_CHANNEL,channel);
+//    writeData(PORT_PHASE,phase);
+    quint8 states[2] = {channel, phase};
+    //  the board inputs no longer hold the latched handle
+    m_latchedHandle = PATTERN_HANDLE_NONE;
+    bool success = writeData(PORT_CHANNEL,2,states);
+    if (channel < TRANSDUCER_COUNT)
+    {
+        //  a failed write may have left anything in the channel, the
+        //  differential upload must not skip it next time
+        m_phase[channel] = phase;
+        m_phaseKnown.set(channel,success);
+    }
+    return success;
 }
 
-void DOController::loadPhase()
+bool DOController::loadPhase()
 {
 //    quint8 byteForLoad = (quint8)128;
 //    quint8 byteForLock = (quint8)0;
 //    writeData(PORT_LOAD,byteForLoad);
-    writeData(PORT_LOAD,BYTE_LOAD);
+//    writeData(PORT_LOAD,BYTE_LOAD);
 //    writeData(PORT_LOAD,byteForLock);
-    writeData(PORT_LOAD,BYTE_LOCK);
+//    writeData(PORT_LOAD,BYTE_LOCK);
+    //  only the load bit toggles, the enable bit on the same port is kept
+    bool success = writeBits(PORT_LOAD,MASK_LOAD,BYTE_LOAD);
+    //  the board latches on this edge, not when the lock byte is back
+    if (m_strobeClock != 0)
+        m_strobeNs = m_strobeClock->nsecsElapsed();
+    success = success && writeBits(PORT_LOAD,MASK_LOAD,BYTE_LOCK);
+    if (success)
+    {
+        latch();
+    }else
+    {
+        //  the edge may or may not have gone out, what the outputs hold
+        //  is unknown until the next strobe
+        m_latchedKnown.reset();
+        m_latchedHandle = PATTERN_HANDLE_NONE;
+    }
+    return success;
+}
+
+int DOController::loadPattern(const quint8 phases[TRANSDUCER_COUNT],
+                              int timeout, const CancelToken *token)
+{
+    pollDevice();
+    QElapsedTimer timer;
+    timer.start();
+    Deadline deadline(timeout,token);
+
+    int channel = uploadPattern(phases,deadline,true);
+    m_uploadNs = timer.nsecsElapsed();
+    return channel;
+}
+
+int DOController::loadPattern(const PatternStore &store, PatternHandle handle,
+                              int timeout, const CancelToken *token)
+{
+    if (!store.contains(handle))
+    {
+        pushError(DO_ERROR_PARAMETER,handle,-1);
+        return 0;
+    }
+    pollDevice();
+    QElapsedTimer timer;
+    timer.start();
+
+    //  equal handles of one store are equal patterns, no byte to compare
+    if (m_differential && handle == m_latchedHandle && &store == m_latchedStore &&
+        store.generation() == m_latchedGeneration && m_latchedKnown.all())
+    {
+        m_channelsSkipped += TRANSDUCER_COUNT;
+        m_uploadNs = timer.nsecsElapsed();
+        return TRANSDUCER_COUNT;
+    }
+
+    Deadline deadline(timeout,token);
+    const quint8 *phases = store.pattern(handle);
+    int channel = uploadPattern(phases,deadline,true);
+    if (channel == TRANSDUCER_COUNT && m_latchedKnown.all() &&
+        memcmp(m_latched,phases,TRANSDUCER_COUNT) == 0)
+    {
+        m_latchedStore = &store;
+        m_latchedGeneration = store.generation();
+        m_latchedHandle = handle;
+    }
+    m_uploadNs = timer.nsecsElapsed();
+    return channel;
+}
+
+int DOController::stagePattern(const quint8 phases[TRANSDUCER_COUNT],
+                               int timeout, const CancelToken *token)
+{
+    pollDevice();
+    QElapsedTimer timer;
+    timer.start();
+    Deadline deadline(timeout,token);
+
+    int channel = TRANSDUCER_COUNT;
+    if (m_latchOnStrobe)
+    {
+        //  the outputs keep the latched phases until the next strobe
+        channel = uploadPattern(phases,deadline,false);
+    }else
+    {
+        //  nothing may reach the board before commit(); the samples are
+        //  built then, from the port states of that moment, an enable()
+        //  or another upload in between would make them stale
+        memcpy(m_staged,phases,TRANSDUCER_COUNT);
+    }
+    m_stagedReady = (channel == TRANSDUCER_COUNT);
+    m_uploadNs = timer.nsecsElapsed();
+    return channel;
+}
+
+bool DOController::commit()
+{
+    //  a staged pattern does not survive the device going away
+    pollDevice();
+    return commitNow();
+}
+
+bool DOController::commitNow(const QElapsedTimer *clock)
+{
+    m_strobeNs = 0;
+    //  a board that came back has lost what was staged on it; it is not
+    //  recovered here, that would hold up the boards latching with it
+    if (m_backend->reconnections() != m_reconnections)
+        return false;
+    QElapsedTimer timer;
+    timer.start();
+
+    bool success = false;
+    m_strobeClock = clock;
+    if (m_stagedReady)
+    {
+        if (m_latchOnStrobe)
+            success = loadPhase();
+        else
+            success = (uploadPattern(m_staged,Deadline(),true) == TRANSDUCER_COUNT);
+    }
+    if (clock != 0 && success && m_buffered && !m_latchOnStrobe)
+        m_strobeNs = clock->nsecsElapsed();
+    m_strobeClock = 0;
+    m_stagedReady = false;
+    m_commitNs = timer.nsecsElapsed();
+    return success;
+}
+
+int DOController::uploadPattern(const quint8 phases[TRANSDUCER_COUNT],
+                                const Deadline &deadline, bool strobe)
+{
+    if (m_buffered)
+    {
+        int sampleCount = compilePattern(phases,strobe);
+        return streamPattern(phases,sampleCount,strobe,deadline) ? TRANSDUCER_COUNT : 0;
+    }
+
+    int channel = 0;
+    m_aborted = false;
+    for (;channel<TRANSDUCER_COUNT;channel++)
+    {
+        if (deadline.reached())
+            break;
+        if (!phaseChanged(channel,phases[channel]))
+        {
+            m_channelsSkipped++;
+            continue;
+        }
+        bool sent = sendPhase((quint8)channel,phases[channel]);
+        if (m_aborted)
+            break;
+        //  under DO_POLICY_CONTINUE a failed channel is passed over
+        if (sent)
+            m_channelsSent++;
+    }
+
+    //  a single strobe latches the whole pattern, without it the upload
+    //  is one short of complete for every caller
+    if (strobe && channel == TRANSDUCER_COUNT && !loadPhase())
+    {
+        channel--;
+    }
+    return channel;
+}
+
+void DOController::latch()
+{
+    memcpy(m_latched,m_phase,TRANSDUCER_COUNT);
+    m_latchedKnown = m_phaseKnown;
+    m_latchedHandle = PATTERN_HANDLE_NONE;
+}
+
+//  a sample spans the strobe, channel and phase ports
+Q_STATIC_ASSERT(PORT_CHANNEL == PORT_LOAD + 1 && DO_SAMPLE_PORTS == 3);
+
+int DOController::compilePattern(const quint8 phases[TRANSDUCER_COUNT], bool strobe)
+{
+    //  the same sequence as sendPhase() for every channel then loadPhase(),
+    //  each sample holding ports PORT_LOAD, PORT_CHANNEL and PORT_PHASE
+    quint8 lock = (shadow(PORT_LOAD) & ~MASK_LOAD) | BYTE_LOCK;
+    quint8 load = (shadow(PORT_LOAD) & ~MASK_LOAD) | BYTE_LOAD;
+    quint8 channelState = shadow(PORT_CHANNEL);
+    quint8 phaseState = shadow(PORT_PHASE);
+    quint8 *sample = m_samples;
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        if (!phaseChanged(channel,phases[channel]))
+            continue;
+        channelState = (quint8)channel;
+        phaseState = phases[channel];
+        sample[0] = lock;
+        sample[1] = channelState;
+        sample[2] = phaseState;
+        sample += DO_SAMPLE_PORTS;
+    }
+    if (strobe)
+    {
+        sample[0] = load;
+        sample[1] = channelState;
+        sample[2] = phaseState;
+        sample += DO_SAMPLE_PORTS;
+        sample[0] = lock;
+        sample[1] = channelState;
+        sample[2] = phaseState;
+        sample += DO_SAMPLE_PORTS;
+    }
+
+    return (sample - m_samples) / DO_SAMPLE_PORTS;
+}
+
+bool DOController::streamPattern(const quint8 phases[TRANSDUCER_COUNT], int sampleCount,
+                                 bool strobe, const Deadline &deadline)
+{
+    if (deadline.reached())
+        return false;
+    //  staging a pattern that is already on the board
+    if (sampleCount == 0)
+    {
+        m_channelsSkipped += TRANSDUCER_COUNT;
+        return true;
+    }
+
+    DOErrorCode errorCode = DO_SUCCESS;
+    errorCode = m_backend->streamPorts(PORT_LOAD,DO_SAMPLE_PORTS,m_samples,sampleCount,
+                                       DO_SAMPLE_RATE,deadline);
+    if (errorCode != DO_SUCCESS)
+    {
+        //  running out of time is the caller's decision, not a device error
+        if (!deadline.reached())
+        {
+            checkError(errorCode,PORT_LOAD);
+        }
+        return false;
+    }
+
+    //  the ports hold the last sample once the buffer is out
+    const quint8 *sample = m_samples + (sampleCount - 1) * DO_SAMPLE_PORTS;
+    for (int i=0;i<DO_SAMPLE_PORTS;i++)
+    {
+        setShadow(PORT_LOAD + i,sample[i],true);
+    }
+
+    int sent = strobe ? sampleCount - 2 : sampleCount;
+    m_channelsSent += sent;
+    m_channelsSkipped += TRANSDUCER_COUNT - sent;
+    memcpy(m_phase,phases,TRANSDUCER_COUNT);
+    m_phaseKnown.set();
+    m_latchedHandle = PATTERN_HANDLE_NONE;
+    if (strobe)
+    {
+        latch();
+    }
+    return true;
 }
 
 //void DOController::enable()
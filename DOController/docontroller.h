@@ -2,13 +2,19 @@
 #define DOCONTROLLER_H
 
 #include <QObject>
+#include <QElapsedTimer>
+#include <bitset>
 
 #include "docontroller_global.h"
-#include "inc/bdaqctrl.h"
+#include "dobackend.h"
+#include "doerror.h"
 #include "variable.h"
 #include "constant.h"
+#include "deadline.h"
+#include "spscring.h"
+#include "patternstore.h"
 
-using namespace Automation::BDaq;
+#define DO_ERROR_RING 256
 
 class DOCONTROLLERSHARED_EXPORT DOController : public QObject
 {
@@ -16,23 +22,186 @@ class DOCONTROLLERSHARED_EXPORT DOController : public QObject
 
 public:
     DOController(QObject *parent = 0);
+    //  run on another backend, e.g. MockDOBackend; takes ownership of it.
+    //  parent has no default, DOController(0) stays the QObject* one
+    DOController(DOBackend *backend, QObject *parent);
+    //  one of several boards, selected by its description, e.g. "USB-4751,BID#1"
+    DOController(const QString& deviceName, QObject *parent = 0);
     ~DOController();
 
-    inline bool exist() {return m_instantDoCtrl != NULL ? true : false;}
-    void writeData(int port, quint8 state);
-    void sendPhase(quint8 channel, quint8 phase);
-    void loadPhase();
-    inline void enable() { writeData(PORT_ENABLE,BYTE_ENABLE); }
-    inline void disable(){ writeData(PORT_DISABLE,BYTE_DISABLE); }
+    inline bool exist() {return m_backend->isOpen();}
+    inline DOBackend* backend() const { return m_backend; }
+    inline QString deviceName() const { return m_deviceName; }
+    bool writeData(int port, quint8 state);
+    //  write portCount contiguous ports in one driver call
+    bool writeData(int portStart, int portCount, quint8 states[]);
+    //  false if the channel or the phase did not reach the board
+    bool sendPhase(quint8 channel, quint8 phase);
+    bool loadPhase();
+    //  upload phases[i] to channel i for the whole array, then latch it
+    //  returns the number of channels written, the pattern is latched
+    //  only if all of them were written before the deadline/cancellation;
+    //  with a failed strobe the last channel does not count, so
+    //  TRANSDUCER_COUNT always means latched
+    int loadPattern(const quint8 phases[TRANSDUCER_COUNT],
+                    int timeout = DEADLINE_NONE, const CancelToken* token = 0);
+    //  the pattern handle holds in store; with the differential upload
+    //  the handle the outputs latched last sends nothing at all
+    int loadPattern(const PatternStore& store, PatternHandle handle,
+                    int timeout = DEADLINE_NONE, const CancelToken* token = 0);
+    //  duration of the last loadPattern(), latch included
+    inline qint64 lastUploadNs() const { return m_uploadNs; }
+    //  upload only the channels whose phase differs from the one already
+    //  written to the board, on by default
+    inline void setDifferentialUpload(bool differential) { m_differential = differential; }
+    inline bool differentialUpload() const { return m_differential; }
+    //  forget the phases on the board, the next upload sends every channel
+    inline void invalidatePattern()
+    {
+        m_phaseKnown.reset();
+        m_latchedHandle = PATTERN_HANDLE_NONE;
+    }
+    inline qint64 channelsSent() const { return m_channelsSent; }
+    inline qint64 channelsSkipped() const { return m_channelsSkipped; }
+
+    //  prepare the next pattern while the current one sonicates, then
+    //  commit() latches it at the period boundary; if the board latches
+    //  on the strobe the phases are uploaded at once and commit() is the
+    //  strobe alone, otherwise they wait ready to send until commit()
+    int stagePattern(const quint8 phases[TRANSDUCER_COUNT],
+                     int timeout = DEADLINE_NONE, const CancelToken* token = 0);
+    bool commit();
+    //  commit() without restoring a reconnected device first, it fails
+    //  instead; for commits timed against other boards, which read
+    //  lastStrobeNs() on their shared clock
+    bool commitNow(const QElapsedTimer* clock = 0);
+    //  on the clock of the last commitNow() right after the load bit went
+    //  out, for a streamed pattern once the whole buffer is out
+    inline qint64 lastStrobeNs() const { return m_strobeNs; }
+    inline bool staged() const { return m_stagedReady; }
+    inline void setLatchOnStrobe(bool latchOnStrobe) { m_latchOnStrobe = latchOnStrobe; }
+    inline bool latchOnStrobe() const { return m_latchOnStrobe; }
+    inline qint64 lastCommitNs() const { return m_commitNs; }
+    //  pattern on the outputs since the last strobe
+    inline const quint8* latchedPattern() const { return m_latched; }
+    //  let the device clock out the whole upload from a DO sample buffer,
+    //  returns false and stays on the instant path if buffered DO is missing
+    bool setBufferedMode(bool buffered);
+    inline bool bufferedMode() const { return m_buffered; }
+    inline bool bufferedSupported() const { return m_backend->bufferedSupported(); }
+    //  set the bits of mask on port to bits, keeping the others
+    bool writeBits(int port, quint8 mask, quint8 bits);
+    inline void enable() { writeBits(PORT_ENABLE,MASK_ENABLE,BYTE_ENABLE); }
+    inline void disable(){ writeBits(PORT_DISABLE,MASK_ENABLE,BYTE_DISABLE); }
+
+    //  last value written to each port, writes that would not change
+    //  a port are skipped
+    inline quint8 shadow(int port) const
+    {
+        return (0 <= port && port < DO_PORT_COUNT) ? m_shadow[port] : 0;
+    }
+    inline qint64 writesIssued() const { return m_writesIssued; }
+    inline qint64 writesSkipped() const { return m_writesSkipped; }
+
+    //  read all the ports back in one call and compare them with the
+    //  shadow registers; returns a bit per mismatching port, -1 if the
+    //  read failed. Mismatches go to the error ring as DO_ERROR_READBACK
+    //  and the shadow takes what was read, so the next write is not skipped
+    int verify();
+    inline qint64 verifyCount() const { return m_verifyCount; }
+    inline qint64 verifyMismatches() const { return m_verifyMismatches; }
+    inline int lastVerifyMask() const { return m_verifyMask; }
+
+    //  failed port writes never block, they are counted by type and
+    //  queued; the UI polls and drains them from its own thread
+    void setErrorPolicy(DOERRORPOLICY policy, int retries = DO_ERROR_RETRIES);
+    inline DOERRORPOLICY errorPolicy() const { return m_errorPolicy; }
+    inline quint32 errorCount(DOERROR type) const { return m_errorCount[type].loadAcquire(); }
+    inline quint32 errorsDropped() const { return m_errorsDropped.loadAcquire(); }
+    inline bool errorPending() const { return !m_errors.isEmpty(); }
+    //  copies up to max queued errors, oldest first, returns how many
+    int drainErrors(DOErrorRecord records[], int max);
+
+    //  after the device was unplugged and came back: select it again,
+    //  upload the latched pattern with the outputs off if it was fully
+    //  known, then put every port back as the shadow has it except the
+    //  enable bit, the outputs stay off until enable(); runs from
+    //  loadPattern(), stagePattern() and commit(), or when called
+    bool pollDevice();
+    bool recover();
+    inline bool deviceRemoved() const { return m_backend->removed(); }
+    inline qint64 recoveries() const { return m_recoveries; }
+    inline qint64 lastRecoveryNs() const { return m_recoveryNs; }
 
 signals:
     void error(QString errorString);
+    void recovered(bool success);
 
 private:    
-    InstantDoCtrl *m_instantDoCtrl;
+    DOBackend *m_backend;
     QString m_deviceName;
+    void initialize();
+    qint64 m_uploadNs;
+    bool m_buffered;
+    quint8 m_shadow[DO_PORT_COUNT];
+    quint32 m_shadowValid;
+    qint64 m_writesIssued;
+    qint64 m_writesSkipped;
+    int m_reconnections;
+    qint64 m_recoveries;
+    qint64 m_recoveryNs;
+    qint64 m_verifyCount;
+    qint64 m_verifyMismatches;
+    int m_verifyMask;
+    //  phase written to every channel of the board
+    quint8 m_phase[TRANSDUCER_COUNT];
+    std::bitset<TRANSDUCER_COUNT> m_phaseKnown;
+    bool m_differential;
+    qint64 m_channelsSent;
+    qint64 m_channelsSkipped;
+    quint8 m_latched[TRANSDUCER_COUNT];
+    std::bitset<TRANSDUCER_COUNT> m_latchedKnown;
+    //  the PatternStore pattern both m_phase and m_latched hold, if any
+    const PatternStore *m_latchedStore;
+    quint32 m_latchedGeneration;
+    PatternHandle m_latchedHandle;
+    bool m_latchOnStrobe;
+    quint8 m_staged[TRANSDUCER_COUNT];
+    bool m_stagedReady;
+    qint64 m_commitNs;
+    //  set for the duration of commitNow(), loadPhase() stamps on it
+    const QElapsedTimer *m_strobeClock;
+    qint64 m_strobeNs;
+    int uploadPattern(const quint8 phases[TRANSDUCER_COUNT], const Deadline& deadline,
+                      bool strobe);
+    void latch();
+    inline bool phaseChanged(int channel, quint8 phase) const
+    {
+        return !m_differential || !m_phaseKnown.test(channel) || m_phase[channel] != phase;
+    }
+    void readShadow();
+    void setShadow(int port, quint8 state, bool valid);
+    inline bool shadowed(int port, quint8 state) const
+    {
+        return (0 <= port && port < DO_PORT_COUNT) &&
+               (m_shadowValid & (1 << port)) && m_shadow[port] == state;
+    }
+    //  samples of ports PORT_LOAD ~ PORT_PHASE, one per channel plus the strobe
+    quint8 m_samples[(TRANSDUCER_COUNT + 2) * DO_SAMPLE_PORTS];
     void selectDevice(QString deviceName);
-    void checkError(ErrorCode errorCode);
+    int compilePattern(const quint8 phases[TRANSDUCER_COUNT], bool strobe);
+    bool streamPattern(const quint8 phases[TRANSDUCER_COUNT], int sampleCount,
+                       bool strobe, const Deadline& deadline);
+    DOERRORPOLICY m_errorPolicy;
+    int m_errorRetries;
+    //  set by a failure under DO_POLICY_ABORT, ends the running upload
+    bool m_aborted;
+    QAtomicInt m_errorCount[DO_ERROR_COUNT];
+    QAtomicInt m_errorsDropped;
+    SpscRing<DOErrorRecord,DO_ERROR_RING> m_errors;
+    QElapsedTimer m_clock;
+    void checkError(DOErrorCode errorCode, int port = -1, int attempts = 1);
+    void pushError(DOERROR type, quint32 code, int port, int attempts = 1);
 };
 
 #endif // DOCONTROLLER_H
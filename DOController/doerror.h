@@ -0,0 +1,80 @@
+#ifndef DOERROR_H
+#define DOERROR_H
+
+#include <QtCore/qglobal.h>
+
+//  Error code of a DOBackend call. The values are those of the BDaq
+//  ErrorCode, so that BDaqBackend passes the driver's code on unchanged
+//  and the codes in the records and messages stay the vendor's; the mock
+//  and DOController use the ones named here without the vendor header.
+typedef quint32 DOErrorCode;
+#define DO_SUCCESS 0
+#define DO_CODE_HANDLE_NOT_VALID 0xE0000000
+#define DO_CODE_PARAM_OUT_OF_RANGE 0xE0000001
+#define DO_CODE_BUFFER_TOO_SMALL 0xE0000006
+#define DO_CODE_FUNC_NOT_SUPPORTED 0xE0000008
+#define DO_CODE_PROP_NOT_SUPPORTED 0xE000000A
+#define DO_CODE_DEVICE_NOT_OPENED 0xE0000014
+#define DO_CODE_DEVICE_NOT_EXIST 0xE0000015
+#define DO_CODE_DEVICE_UNRECOGNIZED 0xE0000016
+#define DO_CODE_FUNC_BUSY 0xE0000019
+#define DO_CODE_IO_TIMEOUT 0xE000001C
+
+//  Classes of DAQ errors counted by DOController
+enum DOERROR
+{
+    DO_ERROR_DEVICE,        //  device missing, not opened or removed
+    DO_ERROR_TIMEOUT,       //  I/O timeout, the device did not answer in time
+    DO_ERROR_BUSY,          //  function busy, another operation is running
+    DO_ERROR_PARAMETER,     //  port or value out of range
+    DO_ERROR_UNSUPPORTED,   //  function or property not supported
+    DO_ERROR_READBACK,      //  a port read back differs from what was written
+    DO_ERROR_OTHER,
+    DO_ERROR_COUNT
+};
+
+//  What a failed port write does to the operation it belongs to
+enum DOERRORPOLICY
+{
+    DO_POLICY_RETRY,        //  retry the write, abort once the retries run out
+    DO_POLICY_ABORT,        //  stop the running upload, nothing is latched
+    DO_POLICY_CONTINUE      //  record the error and go on
+};
+
+//  one entry of the error ring, plain data so that pushing never allocates
+typedef struct DOErrorRecord
+{
+    qint64 timestampNs;
+    //  the DOErrorCode, for DO_ERROR_READBACK expected << 8 | read back
+    quint32 code;
+    quint8 type;
+    qint8 port;
+    quint8 attempts;
+    quint8 reserved;
+}_DOErrorRecord;
+
+inline DOERROR doErrorType(DOErrorCode errorCode)
+{
+    switch (errorCode)
+    {
+    case DO_CODE_DEVICE_NOT_EXIST:
+    case DO_CODE_DEVICE_NOT_OPENED:
+    case DO_CODE_DEVICE_UNRECOGNIZED:
+    case DO_CODE_HANDLE_NOT_VALID:
+        return DO_ERROR_DEVICE;
+    case DO_CODE_IO_TIMEOUT:
+        return DO_ERROR_TIMEOUT;
+    case DO_CODE_FUNC_BUSY:
+        return DO_ERROR_BUSY;
+    case DO_CODE_PARAM_OUT_OF_RANGE:
+    case DO_CODE_BUFFER_TOO_SMALL:
+        return DO_ERROR_PARAMETER;
+    case DO_CODE_FUNC_NOT_SUPPORTED:
+    case DO_CODE_PROP_NOT_SUPPORTED:
+        return DO_ERROR_UNSUPPORTED;
+    default:
+        return DO_ERROR_OTHER;
+    }
+}
+
+#endif // DOERROR_H
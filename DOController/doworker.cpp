@@ -0,0 +1,311 @@
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#include <limits.h>
+#include <string.h>
+
+#include "doworker.h"
+
+DOWorker::DOWorker(DOController *controller, QObject *parent) : QThread(parent),
+    m_controller(controller),
+    m_sleeping(0),
+    m_waiters(0),
+    m_stopping(0),
+    m_verifyAfterLatch(0),
+    m_sequence(0),
+    m_completed(0),
+    m_completionsDropped(0),
+    m_stampNs(0)
+{
+}
+
+DOWorker::~DOWorker()
+{
+    stop();
+    delete m_controller;
+}
+
+quint32 DOWorker::submit(DOCommand &command, DOCOMMAND type)
+{
+    //  0 stands for a rejected command
+    quint32 sequence = m_sequence + 1;
+    if (sequence == 0)
+        sequence = 1;
+    command.sequence = sequence;
+    command.type = (quint8)type;
+    if (!m_commands.push(command))
+        return 0;
+
+    m_sequence = sequence;
+    //  the semaphore only when the worker went to sleep on an empty ring
+    if (m_sleeping.testAndSetOrdered(1,0))
+        m_pending.release();
+    return sequence;
+}
+
+quint32 DOWorker::writeData(int port, quint8 state)
+{
+    return writeData(port,1,&state);
+}
+
+quint32 DOWorker::writeData(int portStart, int portCount, const quint8 states[])
+{
+    if (portStart < 0 || portCount <= 0 || portStart + portCount > DO_PORT_COUNT)
+        return 0;
+
+    DOCommand command;
+    command.port = (quint8)portStart;
+    command.portCount = (quint8)portCount;
+    memcpy(command.states,states,portCount);
+    return submit(command,DO_CMD_WRITE);
+}
+
+quint32 DOWorker::writeBits(int port, quint8 mask, quint8 bits)
+{
+    if (port < 0 || port >= DO_PORT_COUNT)
+        return 0;
+
+    DOCommand command;
+    command.port = (quint8)port;
+    command.mask = mask;
+    command.states[0] = bits;
+    return submit(command,DO_CMD_WRITE_BITS);
+}
+
+quint32 DOWorker::loadPattern(const quint8 phases[TRANSDUCER_COUNT], int timeout)
+{
+    DOCommand command;
+    command.timeout = timeout;
+    memcpy(command.phases,phases,TRANSDUCER_COUNT);
+    return submit(command,DO_CMD_LOAD_PATTERN);
+}
+
+quint32 DOWorker::stagePattern(const quint8 phases[TRANSDUCER_COUNT], int timeout)
+{
+    DOCommand command;
+    command.timeout = timeout;
+    memcpy(command.phases,phases,TRANSDUCER_COUNT);
+    return submit(command,DO_CMD_STAGE_PATTERN);
+}
+
+quint32 DOWorker::commit()
+{
+    DOCommand command;
+    return submit(command,DO_CMD_COMMIT);
+}
+
+quint32 DOWorker::enable()
+{
+    DOCommand command;
+    return submit(command,DO_CMD_ENABLE);
+}
+
+quint32 DOWorker::disable()
+{
+    DOCommand command;
+    return submit(command,DO_CMD_DISABLE);
+}
+
+quint32 DOWorker::commitAt(const QAtomicInt *gate, QSemaphore *arrived,
+                           const QElapsedTimer *clock)
+{
+    DOCommand command;
+    command.gate = gate;
+    command.arrived = arrived;
+    command.clock = clock;
+    return submit(command,DO_CMD_COMMIT_GATED);
+}
+
+quint32 DOWorker::verify()
+{
+    DOCommand command;
+    return submit(command,DO_CMD_VERIFY);
+}
+
+void DOWorker::stop()
+{
+    if (isRunning())
+    {
+        m_stopping.fetchAndStoreOrdered(1);
+        m_cancel.cancel();
+        if (m_sleeping.testAndSetOrdered(1,0))
+            m_pending.release();
+        wait();
+    }
+
+    //  the worker is gone, what it left in the ring is never run but still
+    //  completes, so that nobody waits for it
+    DOCommand command;
+    while (m_commands.pop(command))
+    {
+        DOCompletion completion;
+        completion.sequence = command.sequence;
+        completion.type = command.type;
+        completion.result = DO_RESULT_CANCELLED;
+        completion.elapsedNs = 0;
+        completion.stampNs = 0;
+        complete(completion);
+    }
+    m_pending.tryAcquire(m_pending.available());
+    m_sleeping.storeRelease(0);
+    m_stopping.storeRelease(0);
+    m_cancel.reset();
+}
+
+bool DOWorker::waitFor(quint32 sequence, int timeout)
+{
+    if (isDone(sequence))
+        return true;
+
+    //  counted before the check under the lock, so that complete() either
+    //  sees the waiter or the waiter sees the sequence done
+    Deadline deadline(timeout);
+    QMutexLocker locker(&m_doneLock);
+    m_waiters.fetchAndAddOrdered(1);
+    while (!isDone(sequence) && !deadline.expired())
+    {
+        int left = deadline.remaining();
+        m_done.wait(&m_doneLock,left == DEADLINE_NONE ? ULONG_MAX : (unsigned long)left);
+    }
+    m_waiters.fetchAndAddOrdered(-1);
+    return isDone(sequence);
+}
+
+int DOWorker::drainCompletions(DOCompletion completions[], int max)
+{
+    int count = 0;
+    while (count < max && m_completions.pop(completions[count]))
+        count++;
+    return count;
+}
+
+void DOWorker::run()
+{
+    //  latch whose readback is owed
+    quint32 verifyDue = 0;
+    while (m_stopping.loadAcquire() == 0)
+    {
+        DOCommand command;
+        if (!m_commands.pop(command))
+        {
+            //  nothing waits behind the readback now; the shadow it checks
+            //  against includes whatever ran since the latch
+            if (verifyDue != 0)
+            {
+                QElapsedTimer timer;
+                timer.start();
+                DOCompletion completion;
+                completion.sequence = verifyDue;
+                completion.type = DO_CMD_VERIFY;
+                completion.result = m_controller->verify();
+                completion.elapsedNs = timer.nsecsElapsed();
+                completion.stampNs = 0;
+                if (!m_completions.push(completion))
+                {
+                    m_completionsDropped.ref();
+                }
+                verifyDue = 0;
+                continue;
+            }
+            //  announce the sleep before the last look at the ring: a submit
+            //  after that look finds the flag and releases the semaphore
+            m_sleeping.fetchAndStoreOrdered(1);
+            if (!m_commands.isEmpty() || m_stopping.loadAcquire() != 0)
+            {
+                if (!m_sleeping.testAndSetOrdered(1,0))
+                    m_pending.acquire();
+                continue;
+            }
+            if (m_pending.tryAcquire(1,DO_WORKER_IDLE_MS))
+                continue;
+            if (!m_sleeping.testAndSetOrdered(1,0))
+            {
+                //  a submit cleared the flag, its release is on the way
+                m_pending.acquire();
+                continue;
+            }
+            //  idle, an unplugged board is restored before the next command
+            m_controller->pollDevice();
+            continue;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+        m_stampNs = 0;
+        int result = execute(command);
+
+        DOCompletion completion;
+        completion.sequence = command.sequence;
+        completion.type = command.type;
+        completion.result = result;
+        completion.elapsedNs = timer.nsecsElapsed();
+        completion.stampNs = m_stampNs;
+        complete(completion);
+
+        bool latched = (command.type == DO_CMD_COMMIT || command.type == DO_CMD_COMMIT_GATED) ?
+                       result == 1 :
+                       (command.type == DO_CMD_LOAD_PATTERN && result == TRANSDUCER_COUNT);
+        if (latched && verifyAfterLatch())
+        {
+            verifyDue = command.sequence;
+        }
+    }
+}
+
+int DOWorker::execute(const DOCommand &command)
+{
+    //  the deadline of a pattern starts when the worker picks it up
+    switch (command.type)
+    {
+    case DO_CMD_WRITE:
+        return m_controller->writeData(command.port,command.portCount,
+                                       const_cast<quint8*>(command.states)) ? 1 : 0;
+    case DO_CMD_WRITE_BITS:
+        return m_controller->writeBits(command.port,command.mask,command.states[0]) ? 1 : 0;
+    case DO_CMD_LOAD_PATTERN:
+        return m_controller->loadPattern(command.phases,command.timeout,&m_cancel);
+    case DO_CMD_STAGE_PATTERN:
+        return m_controller->stagePattern(command.phases,command.timeout,&m_cancel);
+    case DO_CMD_COMMIT:
+        return m_controller->commit() ? 1 : 0;
+    case DO_CMD_ENABLE:
+        return m_controller->writeBits(PORT_ENABLE,MASK_ENABLE,BYTE_ENABLE) ? 1 : 0;
+    case DO_CMD_DISABLE:
+        return m_controller->writeBits(PORT_DISABLE,MASK_ENABLE,BYTE_DISABLE) ? 1 : 0;
+    case DO_CMD_COMMIT_GATED:
+    {
+        //  spin rather than sleep, waking up would cost more than the skew
+        command.arrived->release();
+        int gate = DO_GATE_CLOSED;
+        while ((gate = command.gate->loadAcquire()) == DO_GATE_CLOSED)
+        {
+            if (m_stopping.loadAcquire() != 0)
+                return 0;
+        }
+        if (gate != DO_GATE_OPEN)
+            return 0;
+        bool success = m_controller->commitNow(command.clock);
+        m_stampNs = m_controller->lastStrobeNs();
+        return success ? 1 : 0;
+    }
+    case DO_CMD_VERIFY:
+        return m_controller->verify();
+    default:
+        return 0;
+    }
+}
+
+void DOWorker::complete(const DOCompletion &completion)
+{
+    if (!m_completions.push(completion))
+    {
+        m_completionsDropped.ref();
+    }
+    m_completed.fetchAndStoreOrdered(completion.sequence);
+    if (m_waiters.fetchAndAddOrdered(0) != 0)
+    {
+        QMutexLocker locker(&m_doneLock);
+        m_done.wakeAll();
+    }
+    emit commandDone(completion.sequence,completion.result);
+}
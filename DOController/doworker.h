@@ -0,0 +1,150 @@
+#ifndef DOWORKER_H
+#define DOWORKER_H
+
+#include <QThread>
+#include <QSemaphore>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+#include "docontroller.h"
+
+#define DO_COMMAND_RING 64
+#define DO_COMPLETION_RING 256
+#define DO_WORKER_IDLE_MS 10
+//  result of a command stop() dropped before it ran
+#define DO_RESULT_CANCELLED -1
+//  states of the gate of DO_CMD_COMMIT_GATED
+#define DO_GATE_CLOSED 0
+#define DO_GATE_OPEN 1
+#define DO_GATE_ABORT -1
+
+enum DOCOMMAND
+{
+    DO_CMD_WRITE,
+    DO_CMD_WRITE_BITS,
+    DO_CMD_LOAD_PATTERN,
+    DO_CMD_STAGE_PATTERN,
+    DO_CMD_COMMIT,
+    DO_CMD_ENABLE,
+    DO_CMD_DISABLE,
+    DO_CMD_COMMIT_GATED,
+    DO_CMD_VERIFY
+};
+
+//  one queued call, the pattern travels inside so nothing is allocated
+typedef struct DOCommand
+{
+    quint32 sequence;
+    quint8 type;
+    quint8 port;
+    quint8 portCount;
+    quint8 mask;
+    int timeout;
+    quint8 states[DO_PORT_COUNT];
+    quint8 phases[TRANSDUCER_COUNT];
+    //  gated commit, shared by the boards latching together
+    const QAtomicInt* gate;
+    QSemaphore* arrived;
+    const QElapsedTimer* clock;
+}_DOCommand;
+
+typedef struct DOCompletion
+{
+    quint32 sequence;
+    quint8 type;
+    //  1/0 for writes and commit, channels written for patterns,
+    //  DOController::verify() for a verify, DO_RESULT_CANCELLED if dropped;
+    //  a verify after a latch carries the sequence of the latch
+    int result;
+    qint64 elapsedNs;
+    //  on the clock of a gated commit right after the load bit went out,
+    //  else 0
+    qint64 stampNs;
+}_DOCompletion;
+
+//  Runs a DOController on its own thread. One thread submits commands
+//  through a lock-free ring and goes on, e.g. computing the next pattern;
+//  each call returns a sequence number to wait for or match against
+//  the completions. Submitting returns 0 when the ring is full. A submit
+//  takes no lock unless the worker is asleep on an empty ring.
+class DOCONTROLLERSHARED_EXPORT DOWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    //  takes ownership of controller, which must not be used directly
+    //  while the worker runs
+    DOWorker(DOController *controller, QObject *parent = 0);
+    ~DOWorker();
+
+    quint32 writeData(int port, quint8 state);
+    quint32 writeData(int portStart, int portCount, const quint8 states[]);
+    quint32 writeBits(int port, quint8 mask, quint8 bits);
+    quint32 loadPattern(const quint8 phases[TRANSDUCER_COUNT], int timeout = DEADLINE_NONE);
+    quint32 stagePattern(const quint8 phases[TRANSDUCER_COUNT], int timeout = DEADLINE_NONE);
+    quint32 commit();
+    quint32 enable();
+    quint32 disable();
+    //  release arrived, wait for gate to open, then commit(), or drop the
+    //  commit on DO_GATE_ABORT; the completion is stamped on clock, which
+    //  all the boards share
+    quint32 commitAt(const QAtomicInt* gate, QSemaphore* arrived, const QElapsedTimer* clock);
+
+    //  read the ports back once the commands before it are done
+    quint32 verify();
+    //  verify after a latch once no command is queued, so the readback
+    //  never holds up the next upload; it completes again under the
+    //  sequence of the latch, type DO_CMD_VERIFY and the result of
+    //  DOController::verify(), a mismatch is non-zero
+    inline void setVerifyAfterLatch(bool verify) { m_verifyAfterLatch.storeRelease(verify ? 1 : 0); }
+    inline bool verifyAfterLatch() const { return m_verifyAfterLatch.loadAcquire() != 0; }
+
+    //  cancels the running pattern and joins, the queued commands complete
+    //  with DO_RESULT_CANCELLED
+    void stop();
+    //  sequence of the last command done, commands finish in order
+    inline quint32 completed() const { return m_completed.loadAcquire(); }
+    inline bool isDone(quint32 sequence) const
+    {
+        return (qint32)(completed() - sequence) >= 0;
+    }
+    //  sleeps until sequence is done, false on timeout
+    bool waitFor(quint32 sequence, int timeout = DEADLINE_NONE);
+    int drainCompletions(DOCompletion completions[], int max);
+    inline quint32 completionsDropped() const { return m_completionsDropped.loadAcquire(); }
+    inline int queued() const { return m_commands.size(); }
+    inline DOController* controller() const { return m_controller; }
+
+signals:
+    void commandDone(quint32 sequence, int result);
+
+protected:
+    void run();
+
+private:
+    DOController *m_controller;
+    SpscRing<DOCommand,DO_COMMAND_RING> m_commands;
+    SpscRing<DOCompletion,DO_COMPLETION_RING> m_completions;
+    //  set by the worker before it sleeps on m_pending, whoever clears it
+    //  owes the semaphore a release
+    QAtomicInt m_sleeping;
+    QSemaphore m_pending;
+    //  waitFor() callers, the worker only wakes them when there are any
+    QAtomicInt m_waiters;
+    QMutex m_doneLock;
+    QWaitCondition m_done;
+    QAtomicInt m_stopping;
+    QAtomicInt m_verifyAfterLatch;
+    CancelToken m_cancel;
+    //  producer side only
+    quint32 m_sequence;
+    QAtomicInteger<quint32> m_completed;
+    QAtomicInteger<quint32> m_completionsDropped;
+    qint64 m_stampNs;
+    quint32 submit(DOCommand& command, DOCOMMAND type);
+    int execute(const DOCommand& command);
+    void complete(const DOCompletion& completion);
+};
+
+#endif // DOWORKER_H
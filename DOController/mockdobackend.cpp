@@ -0,0 +1,131 @@
+#include <string.h>
+
+#include "mockdobackend.h"
+
+#define MOCK_WRITES_RESERVED 4096
+
+MockDOBackend::MockDOBackend(bool buffered) :
+    m_open(false),
+    m_buffered(buffered),
+    m_recording(true),
+    m_latencyNs(0),
+    m_calls(0),
+    m_injected(DO_SUCCESS),
+    m_injectCount(0)
+{
+    memset(m_ports,0,sizeof(m_ports));
+    //  keep the recording out of the timed path
+    m_writes.reserve(MOCK_WRITES_RESERVED);
+    m_clock.start();
+}
+
+DOErrorCode MockDOBackend::open(const QString &deviceName)
+{
+    Q_UNUSED(deviceName);
+    m_open = true;
+    return DO_SUCCESS;
+}
+
+void MockDOBackend::injectError(DOErrorCode errorCode, int count)
+{
+    m_injected = errorCode;
+    m_injectCount = count;
+}
+
+void MockDOBackend::simulateRemoval()
+{
+    m_open = false;
+    notifyRemoved();
+}
+
+void MockDOBackend::simulateReconnect()
+{
+    memset(m_ports,0,sizeof(m_ports));
+    notifyReconnected();
+}
+
+DOErrorCode MockDOBackend::call()
+{
+    m_calls++;
+    if (m_latencyNs > 0)
+    {
+        qint64 until = m_clock.nsecsElapsed() + m_latencyNs;
+        while (m_clock.nsecsElapsed() < until)
+        {
+        }
+    }
+    if (m_injectCount > 0)
+    {
+        m_injectCount--;
+        return m_injected;
+    }
+    return m_open ? DO_SUCCESS : DO_CODE_DEVICE_NOT_OPENED;
+}
+
+bool MockDOBackend::validRange(int portStart, int portCount) const
+{
+    return 0 <= portStart && 0 < portCount && portStart + portCount <= DO_PORT_COUNT;
+}
+
+void MockDOBackend::record(qint64 timestampNs, int portStart, int portCount,
+                           const quint8 states[])
+{
+    memcpy(m_ports + portStart,states,portCount);
+    if (!m_recording)
+        return;
+
+    PortWrite write;
+    write.timestampNs = timestampNs;
+    write.portStart = portStart;
+    write.portCount = portCount;
+    memset(write.states,0,sizeof(write.states));
+    memcpy(write.states,states,portCount);
+    m_writes.append(write);
+}
+
+DOErrorCode MockDOBackend::writePorts(int portStart, int portCount, const quint8 states[])
+{
+    DOErrorCode errorCode = call();
+    if (errorCode != DO_SUCCESS)
+        return errorCode;
+    if (!validRange(portStart,portCount))
+        return DO_CODE_PARAM_OUT_OF_RANGE;
+
+    record(m_clock.nsecsElapsed(),portStart,portCount,states);
+    return DO_SUCCESS;
+}
+
+DOErrorCode MockDOBackend::readPorts(int portStart, int portCount, quint8 states[])
+{
+    DOErrorCode errorCode = call();
+    if (errorCode != DO_SUCCESS)
+        return errorCode;
+    if (!validRange(portStart,portCount))
+        return DO_CODE_PARAM_OUT_OF_RANGE;
+
+    memcpy(states,m_ports + portStart,portCount);
+    return DO_SUCCESS;
+}
+
+DOErrorCode MockDOBackend::streamPorts(int portStart, int portCount,
+                                       const quint8 samples[], int sampleCount,
+                                       double rate, const Deadline &deadline)
+{
+    if (!m_buffered)
+        return DO_CODE_FUNC_NOT_SUPPORTED;
+    DOErrorCode errorCode = call();
+    if (errorCode != DO_SUCCESS)
+        return errorCode;
+    if (!validRange(portStart,portCount) || rate <= 0)
+        return DO_CODE_PARAM_OUT_OF_RANGE;
+
+    //  samples are stamped at the times the sample clock would put them out
+    qint64 start = m_clock.nsecsElapsed();
+    for (int i=0;i<sampleCount;i++)
+    {
+        if (deadline.reached())
+            return DO_CODE_IO_TIMEOUT;
+        record(start + (qint64)(i * 1e9 / rate),portStart,portCount,samples + i * portCount);
+    }
+    return DO_SUCCESS;
+}
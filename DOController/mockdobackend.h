@@ -0,0 +1,71 @@
+#ifndef MOCKDOBACKEND_H
+#define MOCKDOBACKEND_H
+
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "dobackend.h"
+#include "constant.h"
+
+//  one port write seen by the mock, a streamed sample counts as a write
+typedef struct PortWrite
+{
+    //  from the creation of the mock
+    qint64 timestampNs;
+    quint8 portStart;
+    quint8 portCount;
+    quint8 states[DO_PORT_COUNT];
+}_PortWrite;
+
+//  In-memory DOBackend that keeps the port state and timestamps every
+//  write, so the upload and latch logic runs and can be measured
+//  without the vendor driver or the device
+class DOCONTROLLERSHARED_EXPORT MockDOBackend : public DOBackend
+{
+public:
+    MockDOBackend(bool buffered = false);
+
+    DOErrorCode open(const QString& deviceName);
+    inline bool isOpen() const { return m_open; }
+
+    DOErrorCode writePorts(int portStart, int portCount, const quint8 states[]);
+    DOErrorCode readPorts(int portStart, int portCount, quint8 states[]);
+
+    inline bool bufferedSupported() const { return m_buffered; }
+    DOErrorCode streamPorts(int portStart, int portCount,
+                            const quint8 samples[], int sampleCount,
+                            double rate, const Deadline& deadline);
+
+    //  busy time of every call, to stand in for the USB round trip
+    inline void setCallLatencyNs(qint64 latency) { m_latencyNs = latency; }
+    //  the next count calls fail with errorCode
+    void injectError(DOErrorCode errorCode, int count = 1);
+    //  unplug: calls fail until open(); plug back in: the ports power up at 0
+    void simulateRemoval();
+    void simulateReconnect();
+
+    inline quint8 port(int port) const { return m_ports[port]; }
+    inline const QVector<PortWrite>& writes() const { return m_writes; }
+    inline qint64 calls() const { return m_calls; }
+    inline void clearWrites() { m_writes.clear(); }
+    //  keep the port state without growing writes(), for long runs
+    inline void setRecording(bool recording) { m_recording = recording; }
+
+private:
+    bool m_open;
+    bool m_buffered;
+    bool m_recording;
+    quint8 m_ports[DO_PORT_COUNT];
+    QVector<PortWrite> m_writes;
+    QElapsedTimer m_clock;
+    qint64 m_latencyNs;
+    qint64 m_calls;
+    DOErrorCode m_injected;
+    int m_injectCount;
+
+    DOErrorCode call();
+    bool validRange(int portStart, int portCount) const;
+    void record(qint64 timestampNs, int portStart, int portCount, const quint8 states[]);
+};
+
+#endif // MOCKDOBACKEND_H
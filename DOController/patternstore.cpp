@@ -0,0 +1,82 @@
+#include <QAtomicInteger>
+
+#include <string.h>
+
+#include "patternstore.h"
+
+//  generations are unique in the process, a store rebuilt at the address
+//  of a dead one never matches what DOController remembers of it
+static QAtomicInteger<quint32> generations(0);
+
+Q_STATIC_ASSERT(TRANSDUCER_COUNT % sizeof(quint64) == 0);
+
+PatternStore::PatternStore() :
+    m_additions(0),
+    m_duplicates(0),
+    m_generation(generations.fetchAndAddRelaxed(1) + 1)
+{
+}
+
+quint64 PatternStore::hash(const quint8 phases[TRANSDUCER_COUNT])
+{
+    //  FNV-1a over 8 bytes at a time, then the murmur3 finalizer to spread
+    //  the word steps over every bit
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    for (int i=0;i<TRANSDUCER_COUNT;i+=sizeof(quint64))
+    {
+        quint64 word;
+        memcpy(&word,phases + i,sizeof(word));
+        hash = (hash ^ word) * Q_UINT64_C(1099511628211);
+    }
+    hash ^= hash >> 33;
+    hash *= Q_UINT64_C(0xff51afd7ed558ccd);
+    hash ^= hash >> 33;
+    hash *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    hash ^= hash >> 33;
+    return hash;
+}
+
+PatternHandle PatternStore::find(const quint8 phases[TRANSDUCER_COUNT]) const
+{
+    return find(hash(phases),phases);
+}
+
+PatternHandle PatternStore::find(quint64 key, const quint8 phases[TRANSDUCER_COUNT]) const
+{
+    QMultiHash<quint64,PatternHandle>::const_iterator found = m_index.constFind(key);
+    while (found != m_index.constEnd() && found.key() == key)
+    {
+        if (memcmp(pattern(found.value()),phases,TRANSDUCER_COUNT) == 0)
+            return found.value();
+        ++found;
+    }
+    return PATTERN_HANDLE_NONE;
+}
+
+PatternHandle PatternStore::add(const quint8 phases[TRANSDUCER_COUNT])
+{
+    m_additions++;
+    quint64 key = hash(phases);
+    PatternHandle handle = find(key,phases);
+    if (handle != PATTERN_HANDLE_NONE)
+    {
+        m_duplicates++;
+        return handle;
+    }
+
+    handle = count();
+    int size = m_arena.size();
+    m_arena.resize(size + TRANSDUCER_COUNT);
+    memcpy(m_arena.data() + size,phases,TRANSDUCER_COUNT);
+    m_index.insert(key,handle);
+    return handle;
+}
+
+void PatternStore::clear()
+{
+    m_arena.clear();
+    m_index.clear();
+    m_additions = 0;
+    m_duplicates = 0;
+    m_generation = generations.fetchAndAddRelaxed(1) + 1;
+}
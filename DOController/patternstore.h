@@ -0,0 +1,58 @@
+#ifndef PATTERNSTORE_H
+#define PATTERNSTORE_H
+
+#include <QHash>
+#include <QVector>
+
+#include "docontroller_global.h"
+#include "constant.h"
+
+//  index of a pattern in its PatternStore
+typedef quint32 PatternHandle;
+#define PATTERN_HANDLE_NONE 0xFFFFFFFF
+
+//  Phase patterns of a plan, every distinct one held once. A pattern is
+//  hashed when added; one already held returns its handle again, so a
+//  raster plan costs a handle per spot and TRANSDUCER_COUNT bytes per
+//  distinct pattern. Equal handles of one store are equal patterns,
+//  which DOController::loadPattern() checks before any byte.
+class DOCONTROLLERSHARED_EXPORT PatternStore
+{
+public:
+    PatternStore();
+
+    PatternHandle add(const quint8 phases[TRANSDUCER_COUNT]);
+    //  PATTERN_HANDLE_NONE if not held
+    PatternHandle find(const quint8 phases[TRANSDUCER_COUNT]) const;
+    //  valid until the next add()
+    inline const quint8* pattern(PatternHandle handle) const
+    {
+        return m_arena.constData() + handle * TRANSDUCER_COUNT;
+    }
+    inline bool contains(PatternHandle handle) const { return handle < (quint32)count(); }
+    //  distinct patterns
+    inline int count() const { return m_arena.size() / TRANSDUCER_COUNT; }
+    inline int bytes() const { return m_arena.size(); }
+    //  add() calls, and those that found the pattern already held
+    inline qint64 additions() const { return m_additions; }
+    inline qint64 duplicates() const { return m_duplicates; }
+    //  every handle is void afterwards
+    void clear();
+    inline void reserve(int patterns) { m_arena.reserve(patterns * TRANSDUCER_COUNT); }
+    //  unique in the process, new on clear(); handles are only compared
+    //  within one
+    inline quint32 generation() const { return m_generation; }
+
+    static quint64 hash(const quint8 phases[TRANSDUCER_COUNT]);
+
+private:
+    QVector<quint8> m_arena;
+    //  patterns by hash, a collision is told apart by the bytes
+    QMultiHash<quint64,PatternHandle> m_index;
+    qint64 m_additions;
+    qint64 m_duplicates;
+    quint32 m_generation;
+    PatternHandle find(quint64 key, const quint8 phases[TRANSDUCER_COUNT]) const;
+};
+
+#endif // PATTERNSTORE_H
@@ -0,0 +1,32 @@
+#-------------------------------------------------
+#
+# Unit tests of DOController on the mock backend
+#
+#-------------------------------------------------
+
+QT       -= gui
+QT       += testlib
+
+TARGET = tst_docontroller
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+#   the controller is built in and runs on MockDOBackend alone,
+#   neither the vendor driver nor the device is needed
+DEFINES += DOCONTROLLER_LIBRARY DOCONTROLLER_NO_BDAQ
+
+INCLUDEPATH += ../lib/common \
+    ../DOController
+
+SOURCES += tst_docontroller.cpp \
+    ../DOController/docontroller.cpp \
+    ../DOController/mockdobackend.cpp \
+    ../DOController/patternstore.cpp
+
+HEADERS += ../DOController/docontroller.h \
+    ../DOController/dobackend.h \
+    ../DOController/doerror.h \
+    ../DOController/mockdobackend.h \
+    ../DOController/patternstore.h
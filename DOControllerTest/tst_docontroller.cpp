@@ -0,0 +1,291 @@
+#include <QtTest>
+#include <new>
+
+#include "docontroller.h"
+#include "mockdobackend.h"
+#include "patternstore.h"
+#include "spscring.h"
+
+class TestDOController : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    //  shadow registers
+    void skipsUnchangedWrite();
+    void writeBitsKeepsOtherBits();
+    void failedWriteIsNotSkipped();
+
+    //  differential upload
+    void sendsOnlyChangedChannels();
+    void resendsAfterFailedWrite();
+    void resendsAfterInvalidate();
+    void failedStrobeIsNotLatched();
+
+    //  pattern store
+    void storeDedupes();
+    void storeHandleSkipsUpload();
+    void storeGenerationAcrossClear();
+    void storeGenerationAcrossRecreate();
+
+    void ringWrapsAround();
+
+private:
+    MockDOBackend *m_mock;
+    DOController *m_controller;
+    quint8 m_pattern[TRANSDUCER_COUNT];
+};
+
+void TestDOController::init()
+{
+    m_mock = new MockDOBackend();
+    m_controller = new DOController(m_mock,0);
+    QVERIFY(m_controller->exist());
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        m_pattern[channel] = (quint8)(channel * 7 + 1);
+    }
+}
+
+void TestDOController::cleanup()
+{
+    //  the controller owns the mock
+    delete m_controller;
+    m_controller = 0;
+    m_mock = 0;
+}
+
+void TestDOController::skipsUnchangedWrite()
+{
+    QVERIFY(m_controller->writeData(PORT_CHANNEL,0x12));
+    qint64 issued = m_controller->writesIssued();
+    qint64 skipped = m_controller->writesSkipped();
+    qint64 calls = m_mock->calls();
+
+    QVERIFY(m_controller->writeData(PORT_CHANNEL,0x12));
+    QCOMPARE(m_controller->writesIssued(),issued);
+    QCOMPARE(m_controller->writesSkipped(),skipped + 1);
+    QCOMPARE(m_mock->calls(),calls);
+
+    QVERIFY(m_controller->writeData(PORT_CHANNEL,0x13));
+    QCOMPARE(m_controller->writesIssued(),issued + 1);
+    QCOMPARE(m_mock->port(PORT_CHANNEL),(quint8)0x13);
+}
+
+void TestDOController::writeBitsKeepsOtherBits()
+{
+    QVERIFY(m_controller->writeData(PORT_ENABLE,0x15));
+    m_controller->enable();
+    QCOMPARE(m_controller->shadow(PORT_ENABLE),(quint8)(0x15 | BYTE_ENABLE));
+    QCOMPARE(m_mock->port(PORT_ENABLE),(quint8)(0x15 | BYTE_ENABLE));
+
+    //  the strobe toggles the load bit on the same port, enable stays
+    QVERIFY(m_controller->loadPhase());
+    QCOMPARE(m_mock->port(PORT_LOAD),(quint8)(0x15 | BYTE_ENABLE | BYTE_LOCK));
+
+    m_controller->disable();
+    QCOMPARE(m_mock->port(PORT_ENABLE),(quint8)0x15);
+
+    //  nothing to change, nothing sent
+    qint64 calls = m_mock->calls();
+    m_controller->disable();
+    QCOMPARE(m_mock->calls(),calls);
+}
+
+void TestDOController::failedWriteIsNotSkipped()
+{
+    m_controller->setErrorPolicy(DO_POLICY_CONTINUE);
+    m_mock->injectError(DO_CODE_IO_TIMEOUT);
+    QVERIFY(!m_controller->writeData(PORT_CHANNEL,0x21));
+    QCOMPARE(m_controller->errorCount(DO_ERROR_TIMEOUT),(quint32)1);
+
+    //  the shadow does not claim what never reached the board
+    qint64 issued = m_controller->writesIssued();
+    QVERIFY(m_controller->writeData(PORT_CHANNEL,0x21));
+    QCOMPARE(m_controller->writesIssued(),issued + 1);
+    QCOMPARE(m_mock->port(PORT_CHANNEL),(quint8)0x21);
+}
+
+void TestDOController::sendsOnlyChangedChannels()
+{
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),(qint64)TRANSDUCER_COUNT);
+    QCOMPARE(memcmp(m_controller->latchedPattern(),m_pattern,TRANSDUCER_COUNT),0);
+
+    m_pattern[10]++;
+    m_pattern[100]++;
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),(qint64)TRANSDUCER_COUNT + 2);
+    QCOMPARE(m_controller->channelsSkipped(),(qint64)TRANSDUCER_COUNT - 2);
+    QCOMPARE(memcmp(m_controller->latchedPattern(),m_pattern,TRANSDUCER_COUNT),0);
+}
+
+void TestDOController::resendsAfterFailedWrite()
+{
+    m_controller->setErrorPolicy(DO_POLICY_CONTINUE);
+    m_mock->injectError(DO_CODE_IO_TIMEOUT);
+    //  the failed channel is passed over, the rest is uploaded and latched
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),(qint64)TRANSDUCER_COUNT - 1);
+
+    //  only the channel that did not reach the board goes again
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),(qint64)TRANSDUCER_COUNT);
+    QCOMPARE(m_mock->port(PORT_PHASE),m_pattern[0]);
+
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),(qint64)TRANSDUCER_COUNT);
+}
+
+void TestDOController::resendsAfterInvalidate()
+{
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),(qint64)TRANSDUCER_COUNT);
+
+    m_controller->invalidatePattern();
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),(qint64)TRANSDUCER_COUNT * 2);
+}
+
+void TestDOController::failedStrobeIsNotLatched()
+{
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+
+    //  every channel is skipped, the strobe is the first write and
+    //  fails through all its retries
+    m_mock->injectError(DO_CODE_IO_TIMEOUT,DO_ERROR_RETRIES + 1);
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT - 1);
+    QCOMPARE(m_controller->errorCount(DO_ERROR_TIMEOUT),(quint32)1);
+
+    //  the phases are still known, only the strobe goes again
+    qint64 sent = m_controller->channelsSent();
+    QCOMPARE(m_controller->loadPattern(m_pattern),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),sent);
+    QCOMPARE(m_mock->port(PORT_LOAD) & MASK_LOAD,BYTE_LOCK);
+}
+
+void TestDOController::storeDedupes()
+{
+    PatternStore store;
+    PatternHandle first = store.add(m_pattern);
+    m_pattern[0]++;
+    PatternHandle second = store.add(m_pattern);
+    m_pattern[0]--;
+    PatternHandle again = store.add(m_pattern);
+
+    QVERIFY(first != second);
+    QCOMPARE(again,first);
+    QCOMPARE(store.count(),2);
+    QCOMPARE(store.bytes(),2 * TRANSDUCER_COUNT);
+    QCOMPARE(store.additions(),(qint64)3);
+    QCOMPARE(store.duplicates(),(qint64)1);
+    QCOMPARE(store.find(m_pattern),first);
+    QCOMPARE(memcmp(store.pattern(first),m_pattern,TRANSDUCER_COUNT),0);
+
+    m_pattern[1]++;
+    QCOMPARE(store.find(m_pattern),(PatternHandle)PATTERN_HANDLE_NONE);
+}
+
+void TestDOController::storeHandleSkipsUpload()
+{
+    PatternStore store;
+    PatternHandle handle = store.add(m_pattern);
+    QCOMPARE(m_controller->loadPattern(store,handle),TRANSDUCER_COUNT);
+    qint64 calls = m_mock->calls();
+
+    //  the handle latched last costs no driver call, the strobe included
+    QCOMPARE(m_controller->loadPattern(store,handle),TRANSDUCER_COUNT);
+    QCOMPARE(m_mock->calls(),calls);
+
+    //  unless the strobe failed since
+    m_mock->injectError(DO_CODE_IO_TIMEOUT,DO_ERROR_RETRIES + 1);
+    QVERIFY(!m_controller->loadPhase());
+    calls = m_mock->calls();
+    QCOMPARE(m_controller->loadPattern(store,handle),TRANSDUCER_COUNT);
+    QVERIFY(m_mock->calls() > calls);
+
+    QCOMPARE(m_controller->loadPattern(store,store.count()),0);
+    QCOMPARE(m_controller->errorCount(DO_ERROR_PARAMETER),(quint32)1);
+}
+
+void TestDOController::storeGenerationAcrossClear()
+{
+    PatternStore store;
+    PatternHandle handle = store.add(m_pattern);
+    QCOMPARE(m_controller->loadPattern(store,handle),TRANSDUCER_COUNT);
+    quint32 generation = store.generation();
+
+    //  the same handle now holds another pattern
+    store.clear();
+    QVERIFY(store.generation() != generation);
+    m_pattern[5]++;
+    QCOMPARE(store.add(m_pattern),handle);
+
+    qint64 sent = m_controller->channelsSent();
+    QCOMPARE(m_controller->loadPattern(store,handle),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),sent + 1);
+    QCOMPARE(memcmp(m_controller->latchedPattern(),m_pattern,TRANSDUCER_COUNT),0);
+}
+
+void TestDOController::storeGenerationAcrossRecreate()
+{
+    //  a new store at the address of the old one, handle 0 in both
+    PatternStore *store = new PatternStore();
+    PatternHandle handle = store->add(m_pattern);
+    QCOMPARE(m_controller->loadPattern(*store,handle),TRANSDUCER_COUNT);
+    quint32 generation = store->generation();
+
+    store->~PatternStore();
+    new (store) PatternStore();
+    QVERIFY(store->generation() != generation);
+    m_pattern[5]++;
+    QCOMPARE(store->add(m_pattern),handle);
+
+    qint64 sent = m_controller->channelsSent();
+    QCOMPARE(m_controller->loadPattern(*store,handle),TRANSDUCER_COUNT);
+    QCOMPARE(m_controller->channelsSent(),sent + 1);
+    QCOMPARE(memcmp(m_controller->latchedPattern(),m_pattern,TRANSDUCER_COUNT),0);
+    delete store;
+}
+
+void TestDOController::ringWrapsAround()
+{
+    SpscRing<int,4> ring;
+    QCOMPARE(ring.capacity(),4);
+    QVERIFY(ring.isEmpty());
+    int item = -1;
+    QVERIFY(!ring.pop(item));
+
+    int pushed = 0;
+    int popped = 0;
+    //  head and tail run many times around the 4 slots
+    for (int round=0;round<10;round++)
+    {
+        while (ring.push(pushed))
+        {
+            pushed++;
+        }
+        QCOMPARE(ring.size(),4);
+        for (int i=0;i<3;i++)
+        {
+            QVERIFY(ring.pop(item));
+            QCOMPARE(item,popped++);
+        }
+        QCOMPARE(ring.size(),1);
+    }
+    while (ring.pop(item))
+    {
+        QCOMPARE(item,popped++);
+    }
+    QCOMPARE(popped,pushed);
+    QCOMPARE(pushed,4 + 9 * 3);
+    QVERIFY(ring.isEmpty());
+}
+
+QTEST_APPLESS_MAIN(TestDOController)
+
+#include "tst_docontroller.moc"
@@ -0,0 +1,41 @@
+#-------------------------------------------------
+#
+# Throughput benchmark of the PhaseEngine
+#
+#-------------------------------------------------
+
+QT       -= gui
+QT       += concurrent
+
+TARGET = PhaseBenchmark
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+#   the engine is built in, on the synthetic spherical cap geometry
+DEFINES += PHASEENGINE_LIBRARY
+
+INCLUDEPATH += ../lib/common \
+    ../PhaseEngine
+
+SOURCES += main.cpp \
+    ../PhaseEngine/phaseengine.cpp \
+    ../PhaseEngine/arraygeometry.cpp \
+    ../PhaseEngine/multifocus.cpp \
+    ../PhaseEngine/steeringgrid.cpp \
+    ../PhaseEngine/patterncache.cpp \
+    ../PhaseEngine/incrementalsteering.cpp
+
+HEADERS += ../PhaseEngine/phaseengine.h \
+    ../PhaseEngine/arraygeometry.h \
+    ../PhaseEngine/multifocus.h \
+    ../PhaseEngine/steeringgrid.h \
+    ../PhaseEngine/patterncache.h \
+    ../PhaseEngine/incrementalsteering.h
+
+#   as in PhaseEngine.pro, a CONFIG+=avx2 build runs only on CPUs with AVX2
+avx2 {
+    msvc: QMAKE_CXXFLAGS += /arch:AVX2
+    else: QMAKE_CXXFLAGS += -mavx2 -mfma
+}
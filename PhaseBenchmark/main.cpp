@@ -0,0 +1,338 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QThread>
+
+#include <math.h>
+
+#include "phaseengine.h"
+#include "multifocus.h"
+#include "steeringgrid.h"
+#include "patterncache.h"
+#include "incrementalsteering.h"
+
+#define BENCH_PATTERNS 100000
+#define BENCH_RANGE 10
+#define BENCH_SOLVES 200
+#define BENCH_RING 8
+#define BENCH_GRID_SAMPLES 2000
+#define BENCH_PASSES 1000
+//  mm per update along the trajectories
+static const double BENCH_TRAJECTORY_STEPS[] = {0.001, 0.01, 0.05};
+#define TWO_PI 6.28318530717958647692
+
+//  same spots on every run so that builds compare
+static QVector<_3DCor> spots(int count, double range)
+{
+    QVector<_3DCor> spots(count);
+    quint32 seed = 1;
+    for (int i=0;i<count;i++)
+    {
+        double offset[3];
+        for (int axis=0;axis<3;axis++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            offset[axis] = ((seed >> 8) / double(1 << 24) * 2 - 1) * range;
+        }
+        spots[i].x = offset[0];
+        spots[i].y = offset[1];
+        spots[i].z = offset[2];
+    }
+    return spots;
+}
+
+//  in double precision and unrounded, what the paths are measured against
+static void focusExact(const PhaseEngine& engine, const _3DCor& spot, double phases[TRANSDUCER_COUNT])
+{
+    const ArrayGeometry& geometry = engine.geometry();
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        double dx = geometry.x()[channel] - spot.x;
+        double dy = geometry.y()[channel] - spot.y;
+        double dz = geometry.z()[channel] - spot.z;
+        double cycles = sqrt(dx * dx + dy * dy + dz * dz) / engine.wavelength();
+        phases[channel] = PHASE_STEPS - (cycles - floor(cycles)) * PHASE_STEPS;
+    }
+}
+
+//  steps between a byte and an exact phase, the short way round
+static double distance(quint8 a, double exact)
+{
+    double difference = fmod(fabs(a - exact),PHASE_STEPS);
+    return qMin(difference,PHASE_STEPS - difference);
+}
+
+//  phase steps between two bytes, the short way round
+static int distance(quint8 a, quint8 b)
+{
+    int difference = qAbs(int(a) - int(b));
+    return qMin(difference,PHASE_STEPS - difference);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    QStringList args = a.arguments();
+    int count = (args.size() > 1) ? args.at(1).toInt() : BENCH_PATTERNS;
+    double range = (args.size() > 2) ? args.at(2).toDouble() : BENCH_RANGE;
+    if (args.size() > 3 || count <= 0 || range < 0)
+    {
+        out << "usage: PhaseBenchmark [patterns] [range mm]" << endl;
+        return 1;
+    }
+
+    PhaseEngine engine;
+    QVector<_3DCor> targets = spots(count,range);
+    quint8 phases[TRANSDUCER_COUNT];
+    quint8 reference[TRANSDUCER_COUNT];
+    quint32 checksum = 0;
+    QElapsedTimer timer;
+
+    timer.start();
+    for (int i=0;i<count;i++)
+    {
+        engine.focusScalar(targets.at(i),phases);
+        checksum += phases[i % TRANSDUCER_COUNT];
+    }
+    qint64 scalarNs = timer.nsecsElapsed();
+
+    timer.start();
+    for (int i=0;i<count;i++)
+    {
+        engine.focus(targets.at(i),phases);
+        checksum += phases[i % TRANSDUCER_COUNT];
+    }
+    qint64 focusNs = timer.nsecsElapsed();
+
+    //  the vector path against the scalar one, byte by byte
+    qint64 differing = 0;
+    int worst = 0;
+    for (int i=0;i<count;i++)
+    {
+        engine.focusScalar(targets.at(i),reference);
+        engine.focus(targets.at(i),phases);
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            int steps = distance(phases[channel],reference[channel]);
+            differing += (steps != 0);
+            worst = qMax(worst,steps);
+        }
+    }
+
+    timer.start();
+    for (int i=0;i<count;i++)
+    {
+        engine.focusFixed(targets.at(i),phases);
+        checksum += phases[i % TRANSDUCER_COUNT];
+    }
+    qint64 fixedNs = timer.nsecsElapsed();
+
+    //  focus() and the fixed-point path against double precision; the
+    //  fixed-point hash is the same from every build
+    double exact[TRANSDUCER_COUNT];
+    double floatMean = 0;
+    double floatWorst = 0;
+    double fixedMean = 0;
+    double fixedWorst = 0;
+    qint64 fixedDiffering = 0;
+    quint32 fixedHash = 2166136261u;
+    for (int i=0;i<count;i++)
+    {
+        focusExact(engine,targets.at(i),exact);
+        engine.focus(targets.at(i),reference);
+        engine.focusFixed(targets.at(i),phases);
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            double floatError = distance(reference[channel],exact[channel]);
+            double fixedError = distance(phases[channel],exact[channel]);
+            floatMean += floatError;
+            floatWorst = qMax(floatWorst,floatError);
+            fixedMean += fixedError;
+            fixedWorst = qMax(fixedWorst,fixedError);
+            fixedDiffering += (phases[channel] != reference[channel]);
+            fixedHash = (fixedHash ^ phases[channel]) * 16777619u;
+        }
+    }
+    floatMean /= qint64(count) * TRANSDUCER_COUNT;
+    fixedMean /= qint64(count) * TRANSDUCER_COUNT;
+
+    out << "patterns:      " << count << " within " << range << " mm" << endl
+        << "wavelength:    " << engine.wavelength() << " mm" << endl
+        << "scalar:        " << count * 1e9 / qMax(scalarNs,Q_INT64_C(1)) << " patterns/s, "
+        << scalarNs / count << " ns/pattern" << endl
+        << "focus (" << (PhaseEngine::simd() ? "avx2" : "scalar") << "): "
+        << count * 1e9 / qMax(focusNs,Q_INT64_C(1)) << " patterns/s, "
+        << focusNs / count << " ns/pattern" << endl
+        << "differing:     " << differing << " of " << qint64(count) * TRANSDUCER_COUNT
+        << " bytes, at most " << worst << " step" << endl
+        << "fixed:         " << count * 1e9 / qMax(fixedNs,Q_INT64_C(1)) << " patterns/s, "
+        << fixedNs / count << " ns/pattern, " << fixedDiffering << " bytes off focus(), hash "
+        << hex << fixedHash << dec << endl
+        << "error focus:   mean " << floatMean << ", at most " << floatWorst << " step" << endl
+        << "error fixed:   mean " << fixedMean << ", at most " << fixedWorst << " step" << endl
+        << "checksum:      " << checksum << endl;
+
+    //  1 ~ MULTIFOCUS_MAX foci on a ring around the natural focus, in the
+    //  calling thread and split over the cores on the global thread pool
+    MultiFocus multiFocus(&engine);
+    int cores = QThread::idealThreadCount();
+    for (int count=1;count<=MULTIFOCUS_MAX;count++)
+    {
+        _3DCor foci[MULTIFOCUS_MAX];
+        for (int focus=0;focus<count;focus++)
+        {
+            double angle = TWO_PI * focus / count;
+            foci[focus].x = (count > 1) ? BENCH_RING * cos(angle) : 0;
+            foci[focus].y = (count > 1) ? BENCH_RING * sin(angle) : 0;
+            foci[focus].z = (focus % 2) * BENCH_RING / 2.0;
+        }
+
+        qint64 solveNs[2];
+        bool solved = true;
+        for (int t=0;t<2;t++)
+        {
+            multiFocus.setThreadCount(t == 0 ? 0 : cores);
+            //  one solve first, the pool starts its threads on demand
+            multiFocus.solve(foci,count);
+            timer.start();
+            for (int i=0;i<BENCH_SOLVES;i++)
+            {
+                solved = multiFocus.solve(foci,count) && solved;
+            }
+            solveNs[t] = timer.nsecsElapsed() / BENCH_SOLVES;
+        }
+
+        double pressure = 0;
+        for (int focus=0;focus<count;focus++)
+        {
+            pressure += multiFocus.pressure(focus) / count;
+        }
+        out << "multifocus " << count << " foci: " << (solved ? "" : "FAILED ")
+            << solveNs[0] / 1000.0 << " us/solve serial, " << solveNs[1] / 1000.0
+            << " us on " << cores << " threads (x" << double(solveNs[0]) / qMax(solveNs[1],Q_INT64_C(1))
+            << "), pressure " << pressure << ", uniformity " << multiFocus.uniformity() << endl;
+    }
+
+    //  lookups over the default grid, the spots clamped into it
+    SteeringGrid grid(&engine);
+    timer.start();
+    grid.build();
+    qint64 buildNs = timer.nsecsElapsed();
+    QVector<_3DCor> inside = spots(count,qMin(range,double(GRID_RANGE_XY)));
+    timer.start();
+    for (int i=0;i<count;i++)
+    {
+        grid.nearest(inside.at(i),phases);
+        checksum += phases[i % TRANSDUCER_COUNT];
+    }
+    qint64 nearestNs = timer.nsecsElapsed();
+    timer.start();
+    for (int i=0;i<count;i++)
+    {
+        grid.interpolated(inside.at(i),phases);
+        checksum += phases[i % TRANSDUCER_COUNT];
+    }
+    qint64 interpolatedNs = timer.nsecsElapsed();
+    SteeringError error = grid.error(BENCH_GRID_SAMPLES);
+    out << "grid:          " << grid.pointCount() << " points, " << grid.bytes() << " bytes, built in "
+        << buildNs / 1000000.0 << " ms" << endl
+        << "nearest:       " << double(nearestNs) / count << " ns/lookup, error mean "
+        << error.meanNearest << " max " << error.maxNearest << " (bound "
+        << error.boundNearest << ") step" << endl
+        << "interpolated:  " << double(interpolatedNs) / count << " ns/lookup, error mean "
+        << error.meanInterpolated << " max " << error.maxInterpolated << " step" << endl
+        << "checksum:      " << checksum << endl;
+
+    //  a plan of TEST_SPOT_COUNT spots passed BENCH_PASSES times, computed
+    //  every time and through the cache
+    QVector<_3DCor> plan = spots(TEST_SPOT_COUNT,range);
+    timer.start();
+    for (int pass=0;pass<BENCH_PASSES;pass++)
+    {
+        for (int i=0;i<plan.size();i++)
+        {
+            engine.focus(plan.at(i),phases);
+            checksum += phases[i];
+        }
+    }
+    qint64 computedNs = timer.nsecsElapsed();
+    PatternCache cache(&engine);
+    timer.start();
+    for (int pass=0;pass<BENCH_PASSES;pass++)
+    {
+        for (int i=0;i<plan.size();i++)
+        {
+            checksum += cache.pattern(plan.at(i))[i];
+        }
+    }
+    qint64 cachedNs = timer.nsecsElapsed();
+    int visits = BENCH_PASSES * plan.size();
+    out << "plan:          " << plan.size() << " spots, " << BENCH_PASSES << " passes" << endl
+        << "computed:      " << double(computedNs) / visits << " ns/spot" << endl
+        << "cached:        " << double(cachedNs) / visits << " ns/spot, " << cache.hits()
+        << " hits, " << cache.misses() << " misses, " << cache.evictions() << " evictions" << endl
+        << "checksum:      " << checksum << endl;
+
+    //  a circle of BENCH_RING mm around the natural focus, wobbling in z,
+    //  followed in small steps; changed channels are what the
+    //  differential upload sends per update
+    for (int s=0;s<(int)(sizeof(BENCH_TRAJECTORY_STEPS) / sizeof(double));s++)
+    {
+        double step = BENCH_TRAJECTORY_STEPS[s];
+        QVector<_3DCor> trajectory(count);
+        for (int i=0;i<count;i++)
+        {
+            double angle = i * step / BENCH_RING;
+            trajectory[i].x = BENCH_RING * cos(angle);
+            trajectory[i].y = BENCH_RING * sin(angle);
+            trajectory[i].z = sin(3 * angle);
+        }
+
+        timer.start();
+        for (int i=0;i<count;i++)
+        {
+            engine.focus(trajectory.at(i),phases);
+            checksum += phases[i % TRANSDUCER_COUNT];
+        }
+        qint64 exactNs = timer.nsecsElapsed();
+
+        IncrementalSteering steering(&engine);
+        qint64 changed = 0;
+        timer.start();
+        for (int i=0;i<count;i++)
+        {
+            changed += steering.update(trajectory.at(i),phases);
+            checksum += phases[i % TRANSDUCER_COUNT];
+        }
+        qint64 incrementalNs = timer.nsecsElapsed();
+        qint64 anchors = steering.anchors();
+
+        double exact[TRANSDUCER_COUNT];
+        double error = 0;
+        double errorWorst = 0;
+        steering.reset();
+        for (int i=0;i<count;i++)
+        {
+            steering.update(trajectory.at(i),phases);
+            focusExact(engine,trajectory.at(i),exact);
+            for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+            {
+                double steps = distance(phases[channel],exact[channel]);
+                error += steps;
+                errorWorst = qMax(errorWorst,steps);
+            }
+        }
+        out << "trajectory " << step << " mm/update: focus " << double(exactNs) / count
+            << " ns, incremental " << double(incrementalNs) / count << " ns, "
+            << count / qMax(anchors,Q_INT64_C(1)) << " updates/anchor, "
+            << double(changed) / count << " channels changed, error mean "
+            << error / (qint64(count) * TRANSDUCER_COUNT) << " at most " << errorWorst
+            << " step" << endl;
+    }
+    out << "checksum:      " << checksum << endl;
+    return 0;
+}
@@ -0,0 +1,44 @@
+#-------------------------------------------------
+#
+# Phase patterns of the transducer array for DOController
+#
+#-------------------------------------------------
+
+QT       -= gui
+QT       += concurrent
+
+TARGET = PhaseEngine
+TEMPLATE = lib
+
+DEFINES += PHASEENGINE_LIBRARY
+
+INCLUDEPATH += ../lib/common
+
+SOURCES += phaseengine.cpp \
+    arraygeometry.cpp \
+    multifocus.cpp \
+    steeringgrid.cpp \
+    patterncache.cpp \
+    incrementalsteering.cpp
+
+HEADERS += phaseengine.h\
+        phaseengine_global.h \
+    arraygeometry.h \
+    multifocus.h \
+    steeringgrid.h \
+    patterncache.h \
+    incrementalsteering.h
+
+#   the AVX2 loops of PhaseEngine are always built and picked at run
+#   time. qmake CONFIG+=avx2 lets the compiler use AVX2 in the rest of
+#   the code too: that build runs only on CPUs with AVX2 and stops with
+#   an illegal instruction on any other
+avx2 {
+    msvc: QMAKE_CXXFLAGS += /arch:AVX2
+    else: QMAKE_CXXFLAGS += -mavx2 -mfma
+}
+
+unix {
+    target.path = /usr/lib
+    INSTALLS += target
+}
@@ -0,0 +1,86 @@
+#include <QSettings>
+
+#include <math.h>
+
+#include "arraygeometry.h"
+
+#define GOLDEN_ANGLE 2.39996322972865332
+
+ArrayGeometry::ArrayGeometry() :
+    m_version(0)
+{
+    setSphericalCap(RADIUS_DEFAULT,APERTURE_DEFAULT);
+}
+
+void ArrayGeometry::readSettings()
+{
+    QSettings* settings = new QSettings(SETTINGS_PATH,QSettings::IniFormat);
+    int size = settings->beginReadArray("Transducers");
+    if (size == TRANSDUCER_COUNT)
+    {
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            settings->setArrayIndex(channel);
+            _3DCor position;
+            position.x = settings->value("x",0).toDouble();
+            position.y = settings->value("y",0).toDouble();
+            position.z = settings->value("z",0).toDouble();
+            setElement(channel,position);
+        }
+    }
+    settings->endArray();
+
+    if (size != TRANSDUCER_COUNT)
+    {
+        setSphericalCap(settings->value("PhaseEngine/radius",RADIUS_DEFAULT).toDouble(),
+                        settings->value("PhaseEngine/aperture",APERTURE_DEFAULT).toDouble());
+    }
+    delete settings;
+}
+
+void ArrayGeometry::setSphericalCap(double radius, double aperture)
+{
+    //  equal areas per element: cos(theta) steps evenly down to the rim,
+    //  the azimuth turns by the golden angle
+    double rim = qMin(aperture / 2,radius);
+    double cosRim = sqrt(1 - (rim / radius) * (rim / radius));
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        double cosTheta = 1 - (1 - cosRim) * (channel + 0.5) / TRANSDUCER_COUNT;
+        double sinTheta = sqrt(1 - cosTheta * cosTheta);
+        double phi = channel * GOLDEN_ANGLE;
+        m_x[channel] = (float)(radius * sinTheta * cos(phi));
+        m_y[channel] = (float)(radius * sinTheta * sin(phi));
+        m_z[channel] = (float)(-radius * cosTheta);
+        roundFixed(channel);
+    }
+    m_version++;
+}
+
+void ArrayGeometry::setElement(int channel, const _3DCor &position)
+{
+    if (0 <= channel && channel < TRANSDUCER_COUNT)
+    {
+        m_x[channel] = (float)position.x;
+        m_y[channel] = (float)position.y;
+        m_z[channel] = (float)position.z;
+        roundFixed(channel);
+        m_version++;
+    }
+}
+
+void ArrayGeometry::roundFixed(int channel)
+{
+    m_xFixed[channel] = (qint32)lrint(m_x[channel] * (double)GEOMETRY_FIXED_UNIT);
+    m_yFixed[channel] = (qint32)lrint(m_y[channel] * (double)GEOMETRY_FIXED_UNIT);
+    m_zFixed[channel] = (qint32)lrint(m_z[channel] * (double)GEOMETRY_FIXED_UNIT);
+}
+
+_3DCor ArrayGeometry::element(int channel) const
+{
+    _3DCor position;
+    position.x = m_x[channel];
+    position.y = m_y[channel];
+    position.z = m_z[channel];
+    return position;
+}
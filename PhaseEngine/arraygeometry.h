@@ -0,0 +1,50 @@
+#ifndef ARRAYGEOMETRY_H
+#define ARRAYGEOMETRY_H
+
+#include "phaseengine_global.h"
+#include "variable.h"
+#include "constant.h"
+
+//  fixed-point positions per mm, 1/16 um
+#define GEOMETRY_FIXED_UNIT 16000
+
+//  Positions of the transducers in mm, natural focus at the origin and
+//  the beam along +z. Kept as three float arrays rather than an array
+//  of _3DCor so that the phase loops load 8 elements at once.
+class PHASEENGINESHARED_EXPORT ArrayGeometry
+{
+public:
+    ArrayGeometry();
+
+    //  [Transducers] in the settings, x, y and z of every element when
+    //  all TRANSDUCER_COUNT are listed, else the spherical cap of
+    //  PhaseEngine/radius and PhaseEngine/aperture
+    void readSettings();
+    //  elements spread evenly over a cap of the sphere of radius
+    //  around the natural focus, aperture being the diameter of its rim
+    void setSphericalCap(double radius, double aperture);
+    void setElement(int channel, const _3DCor& position);
+
+    inline const float* x() const { return m_x; }
+    inline const float* y() const { return m_y; }
+    inline const float* z() const { return m_z; }
+    //  the same positions in GEOMETRY_FIXED_UNIT, for the fixed-point path
+    inline const qint32* xFixed() const { return m_xFixed; }
+    inline const qint32* yFixed() const { return m_yFixed; }
+    inline const qint32* zFixed() const { return m_zFixed; }
+    _3DCor element(int channel) const;
+    //  bumped on every change, for whoever caches what was computed on it
+    inline int version() const { return m_version; }
+
+private:
+    float m_x[TRANSDUCER_COUNT];
+    float m_y[TRANSDUCER_COUNT];
+    float m_z[TRANSDUCER_COUNT];
+    qint32 m_xFixed[TRANSDUCER_COUNT];
+    qint32 m_yFixed[TRANSDUCER_COUNT];
+    qint32 m_zFixed[TRANSDUCER_COUNT];
+    int m_version;
+    void roundFixed(int channel);
+};
+
+#endif // ARRAYGEOMETRY_H
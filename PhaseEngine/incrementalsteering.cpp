@@ -0,0 +1,140 @@
+#include <math.h>
+#include <string.h>
+
+#include "incrementalsteering.h"
+
+//  the delay wraps with the period at 2^32, the moves add in 2^-24 periods
+#define DELAY_BITS 32
+#define MOVE_BITS 24
+Q_STATIC_ASSERT(PHASE_STEPS == 1 << (DELAY_BITS - MOVE_BITS));
+
+IncrementalSteering::IncrementalSteering(const PhaseEngine *engine) :
+    m_engine(engine),
+    m_tolerance(INCREMENTAL_TOLERANCE),
+    m_reanchorInterval(INCREMENTAL_REANCHOR),
+    m_anchored(false),
+    m_version(-1),
+    m_wavelength(0),
+    m_radius(0),
+    m_sinceAnchor(0),
+    m_updates(0),
+    m_anchors(0)
+{
+    m_anchor.x = 0;
+    m_anchor.y = 0;
+    m_anchor.z = 0;
+    memset(m_pattern,0,sizeof(m_pattern));
+}
+
+void IncrementalSteering::setTolerance(double tolerance)
+{
+    m_tolerance = qMax(0.0,tolerance);
+}
+
+void IncrementalSteering::anchorAt(const _3DCor &spot, quint8 phases[TRANSDUCER_COUNT])
+{
+    const ArrayGeometry& geometry = m_engine->geometry();
+    double wavelength = m_engine->wavelength();
+    //  the paths from the vector loop of the engine, the rest in loops
+    //  without calls or branches, so that each of them vectorizes too;
+    //  into local arrays first, as in update(), the geometry and phases
+    //  could alias the members for all the compiler knows
+    float path[TRANSDUCER_COUNT];
+    double nearest = m_engine->paths(spot,path);
+    quint32 delay[TRANSDUCER_COUNT];
+    float waveNumber = (float)(1 / wavelength);
+    float period = ldexpf(1.0f,DELAY_BITS);
+    float half = ldexpf(1.0f,DELAY_BITS - 1);
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        float cycles = path[channel] * waveNumber;
+        //  the farther the element, the earlier it fires, as in focus(): the
+        //  delay is minus the fraction modulo 2^32. The conversions through
+        //  qint32, which vectors have, stand for floorf(): the cycles are
+        //  never negative, the fraction is offset by half a period
+        float fraction = (cycles - (float)(qint32)cycles) * period;
+        delay[channel] = 0u - ((quint32)(qint32)(fraction - half) + (1u << (DELAY_BITS - 1)));
+    }
+    //  unit vector from the spot to the element, per wavelength
+    const float *x = geometry.x();
+    const float *y = geometry.y();
+    const float *z = geometry.z();
+    float perMm = (float)(ldexp(1.0,MOVE_BITS) / wavelength);
+    float sx = (float)spot.x;
+    float sy = (float)spot.y;
+    float sz = (float)spot.z;
+    float gradientX[TRANSDUCER_COUNT];
+    float gradientY[TRANSDUCER_COUNT];
+    float gradientZ[TRANSDUCER_COUNT];
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        float scale = perMm / path[channel];
+        gradientX[channel] = (x[channel] - sx) * scale;
+        gradientY[channel] = (y[channel] - sy) * scale;
+        gradientZ[channel] = (z[channel] - sz) * scale;
+    }
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        phases[channel] = (quint8)((delay[channel] + (1u << (MOVE_BITS - 1))) >> MOVE_BITS);
+    }
+    memcpy(m_delay,delay,sizeof(m_delay));
+    memcpy(m_gradientX,gradientX,sizeof(m_gradientX));
+    memcpy(m_gradientY,gradientY,sizeof(m_gradientY));
+    memcpy(m_gradientZ,gradientZ,sizeof(m_gradientZ));
+
+    //  the path of a move delta off its direction is short by at most
+    //  delta^2 / 2d, within the tolerance up to this radius
+    m_radius = sqrt(2 * nearest * wavelength * m_tolerance / PHASE_STEPS);
+    m_anchor = spot;
+    m_version = geometry.version();
+    m_wavelength = wavelength;
+    m_sinceAnchor = 0;
+    m_anchored = true;
+    m_anchors++;
+}
+
+int IncrementalSteering::update(const _3DCor &spot, quint8 phases[TRANSDUCER_COUNT])
+{
+    //  into a local pattern first: bytes written through phases could
+    //  alias the members and keep the loops from vectorizing
+    quint8 next[TRANSDUCER_COUNT];
+    float deltaX = (float)(spot.x - m_anchor.x);
+    float deltaY = (float)(spot.y - m_anchor.y);
+    float deltaZ = (float)(spot.z - m_anchor.z);
+    double move = sqrt(double(deltaX) * deltaX + double(deltaY) * deltaY + double(deltaZ) * deltaZ);
+    if (!m_anchored || move > m_radius || m_sinceAnchor >= m_reanchorInterval ||
+        m_version != m_engine->geometry().version() || m_wavelength != m_engine->wavelength())
+    {
+        anchorAt(spot,next);
+    }else
+    {
+        //  the path shortens by u.delta, the delay grows by as much; integer
+        //  wrap-around instead of floor() keeps the loop vectorizable
+        quint32 delay[TRANSDUCER_COUNT];
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            qint32 move = (qint32)(m_gradientX[channel] * deltaX +
+                                   m_gradientY[channel] * deltaY +
+                                   m_gradientZ[channel] * deltaZ);
+            delay[channel] = (m_delay[channel] + ((quint32)move << (DELAY_BITS - MOVE_BITS)) +
+                              (1u << (MOVE_BITS - 1))) >> MOVE_BITS;
+        }
+        //  narrowed in a loop of its own, so that the one above runs on
+        //  whole vectors of 32-bit lanes
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            next[channel] = (quint8)delay[channel];
+        }
+        m_sinceAnchor++;
+    }
+    m_updates++;
+
+    int changed = 0;
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        changed += (next[channel] != m_pattern[channel]);
+    }
+    memcpy(m_pattern,next,TRANSDUCER_COUNT);
+    memcpy(phases,next,TRANSDUCER_COUNT);
+    return changed;
+}
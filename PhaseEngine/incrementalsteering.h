@@ -0,0 +1,68 @@
+#ifndef INCREMENTALSTEERING_H
+#define INCREMENTALSTEERING_H
+
+#include "phaseengine.h"
+
+//  phase steps the first-order update may be off by before it anchors again
+#define INCREMENTAL_TOLERANCE 0.25
+//  updates between two anchors however small the moves
+#define INCREMENTAL_REANCHOR 256
+
+//  Phases along a trajectory of small moves. At an anchor spot the path
+//  of every element and its direction are computed exactly; a spot
+//  nearby is then d - u.delta, three multiply-adds per element instead
+//  of a square root. The error of that grows with the square of the
+//  move, so once the spot is farther from the anchor than the tolerance
+//  allows, or after INCREMENTAL_REANCHOR updates, the spot becomes the
+//  new anchor. The number of changed channels update() returns is what
+//  DOController::loadPattern() sends with the differential upload on.
+//  Meant for CPUs without AVX2: there an update takes a fifth of
+//  focus() or less. With AVX2 focus() costs as much as an update, and
+//  the anchors come on top of it, so use focus() there.
+class PHASEENGINESHARED_EXPORT IncrementalSteering
+{
+public:
+    IncrementalSteering(const PhaseEngine* engine);
+
+    //  phase steps, takes effect at the next anchor
+    void setTolerance(double tolerance);
+    inline double tolerance() const { return m_tolerance; }
+    inline void setReanchorInterval(int updates) { m_reanchorInterval = qMax(1,updates); }
+    inline int reanchorInterval() const { return m_reanchorInterval; }
+    //  the next update() anchors
+    inline void reset() { m_anchored = false; }
+
+    //  phases of spot into phases, returns the channels that differ from
+    //  the pattern of the previous update
+    int update(const _3DCor& spot, quint8 phases[TRANSDUCER_COUNT]);
+    inline const quint8* pattern() const { return m_pattern; }
+    inline _3DCor anchor() const { return m_anchor; }
+    //  mm from the anchor within which the tolerance holds
+    inline double radius() const { return m_radius; }
+    inline qint64 updates() const { return m_updates; }
+    inline qint64 anchors() const { return m_anchors; }
+
+private:
+    const PhaseEngine *m_engine;
+    double m_tolerance;
+    int m_reanchorInterval;
+    bool m_anchored;
+    int m_version;
+    double m_wavelength;
+    _3DCor m_anchor;
+    double m_radius;
+    int m_sinceAnchor;
+    //  at the anchor, delay of every element with the period at 2^32, and
+    //  its change in 2^-24 periods per mm of move
+    quint32 m_delay[TRANSDUCER_COUNT];
+    float m_gradientX[TRANSDUCER_COUNT];
+    float m_gradientY[TRANSDUCER_COUNT];
+    float m_gradientZ[TRANSDUCER_COUNT];
+    quint8 m_pattern[TRANSDUCER_COUNT];
+    qint64 m_updates;
+    qint64 m_anchors;
+
+    void anchorAt(const _3DCor& spot, quint8 phases[TRANSDUCER_COUNT]);
+};
+
+#endif // INCREMENTALSTEERING_H
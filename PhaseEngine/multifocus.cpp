@@ -0,0 +1,318 @@
+#include <QtConcurrent>
+#include <QThread>
+
+#include <math.h>
+#include <string.h>
+#include <complex>
+
+#include "multifocus.h"
+
+#define TWO_PI 6.28318530717958647692
+
+//  one H H^H per chunk, real and imaginary parts
+#define GRAM_SIZE (MULTIFOCUS_MAX * MULTIFOCUS_MAX * 2)
+
+MultiFocus::MultiFocus(const PhaseEngine *engine) :
+    m_engine(engine),
+    m_threadCount(0),
+    m_iterations(MULTIFOCUS_ITERATIONS),
+    m_count(0),
+    m_uniformity(0)
+{
+    memset(m_phases,0,sizeof(m_phases));
+    memset(m_amplitudes,0,sizeof(m_amplitudes));
+    memset(m_pressure,0,sizeof(m_pressure));
+    setThreadCount(QThread::idealThreadCount());
+}
+
+void MultiFocus::setThreadCount(int threadCount)
+{
+    m_threadCount = qBound(0,threadCount,TRANSDUCER_COUNT);
+    int chunks = qMax(1,m_threadCount);
+    m_chunks.resize(chunks);
+    for (int i=0;i<chunks;i++)
+    {
+        m_chunks[i].solver = this;
+        m_chunks[i].first = TRANSDUCER_COUNT * i / chunks;
+        m_chunks[i].last = TRANSDUCER_COUNT * (i + 1) / chunks;
+        m_chunks[i].stage = STAGE_PROPAGATION;
+    }
+    m_gramParts.resize(chunks * GRAM_SIZE);
+}
+
+void MultiFocus::runChunk(MultiFocusChunk &chunk)
+{
+    MultiFocus *solver = chunk.solver;
+    switch (chunk.stage)
+    {
+    case STAGE_PROPAGATION:
+        //  the part of H H^H of a chunk needs only its own elements of H,
+        //  one trip through the pool does both
+        solver->propagation(chunk.first,chunk.last);
+        solver->gram(&chunk - solver->m_chunks.data(),chunk.first,chunk.last);
+        break;
+    case STAGE_DRIVE:
+        solver->drive(chunk.first,chunk.last);
+        break;
+    }
+}
+
+void MultiFocus::run(int stage)
+{
+    for (int i=0;i<m_chunks.size();i++)
+    {
+        m_chunks[i].stage = stage;
+    }
+    if (m_threadCount <= 1)
+    {
+        for (int i=0;i<m_chunks.size();i++)
+        {
+            runChunk(m_chunks[i]);
+        }
+    }else
+    {
+        QtConcurrent::blockingMap(m_chunks,&MultiFocus::runChunk);
+    }
+}
+
+void MultiFocus::propagation(int first, int last)
+{
+    //  spherical wave from each element, exp(-j 2 pi d / lambda) / d
+    const ArrayGeometry& geometry = m_engine->geometry();
+    double waveNumber = TWO_PI / m_engine->wavelength();
+    for (int focus=0;focus<m_count;focus++)
+    {
+        for (int channel=first;channel<last;channel++)
+        {
+            double dx = geometry.x()[channel] - m_foci[focus].x;
+            double dy = geometry.y()[channel] - m_foci[focus].y;
+            double dz = geometry.z()[channel] - m_foci[focus].z;
+            double distance = sqrt(dx * dx + dy * dy + dz * dz);
+            double phase = -waveNumber * distance;
+            m_hRe[focus][channel] = cos(phase) / distance;
+            m_hIm[focus][channel] = sin(phase) / distance;
+        }
+    }
+}
+
+void MultiFocus::gram(int chunk, int first, int last)
+{
+    //  H H^H is Hermitian, the upper triangle is enough
+    double *part = m_gramParts.data() + chunk * GRAM_SIZE;
+    for (int m=0;m<m_count;m++)
+    {
+        for (int n=m;n<m_count;n++)
+        {
+            double re = 0;
+            double im = 0;
+            for (int channel=first;channel<last;channel++)
+            {
+                re += m_hRe[m][channel] * m_hRe[n][channel] + m_hIm[m][channel] * m_hIm[n][channel];
+                im += m_hIm[m][channel] * m_hRe[n][channel] - m_hRe[m][channel] * m_hIm[n][channel];
+            }
+            part[(m * MULTIFOCUS_MAX + n) * 2] = re;
+            part[(m * MULTIFOCUS_MAX + n) * 2 + 1] = im;
+        }
+    }
+}
+
+void MultiFocus::drive(int first, int last)
+{
+    //  u = H^H c
+    for (int channel=first;channel<last;channel++)
+    {
+        double re = 0;
+        double im = 0;
+        for (int focus=0;focus<m_count;focus++)
+        {
+            re += m_hRe[focus][channel] * m_cRe[focus] + m_hIm[focus][channel] * m_cIm[focus];
+            im += m_hRe[focus][channel] * m_cIm[focus] - m_hIm[focus][channel] * m_cRe[focus];
+        }
+        m_uRe[channel] = re;
+        m_uIm[channel] = im;
+    }
+}
+
+bool MultiFocus::solveSystem(const double pRe[], const double pIm[])
+{
+    //  (H H^H + lambda I) c = p by Gaussian elimination with partial pivoting
+    typedef std::complex<double> Complex;
+    Complex a[MULTIFOCUS_MAX][MULTIFOCUS_MAX + 1];
+    double trace = 0;
+    for (int m=0;m<m_count;m++)
+    {
+        trace += m_gramRe[m][m];
+    }
+    double lambda = MULTIFOCUS_REGULARIZATION * trace / m_count;
+    for (int m=0;m<m_count;m++)
+    {
+        for (int n=0;n<m_count;n++)
+        {
+            a[m][n] = Complex(m_gramRe[m][n],m_gramIm[m][n]);
+        }
+        a[m][m] += lambda;
+        a[m][m_count] = Complex(pRe[m],pIm[m]);
+    }
+
+    for (int column=0;column<m_count;column++)
+    {
+        int pivot = column;
+        for (int row=column+1;row<m_count;row++)
+        {
+            if (std::abs(a[row][column]) > std::abs(a[pivot][column]))
+                pivot = row;
+        }
+        if (std::abs(a[pivot][column]) == 0)
+            return false;
+        if (pivot != column)
+        {
+            for (int n=column;n<=m_count;n++)
+            {
+                std::swap(a[pivot][n],a[column][n]);
+            }
+        }
+        for (int row=column+1;row<m_count;row++)
+        {
+            Complex factor = a[row][column] / a[column][column];
+            for (int n=column;n<=m_count;n++)
+            {
+                a[row][n] -= factor * a[column][n];
+            }
+        }
+    }
+    for (int row=m_count-1;row>=0;row--)
+    {
+        Complex sum = a[row][m_count];
+        for (int n=row+1;n<m_count;n++)
+        {
+            sum -= a[row][n] * Complex(m_cRe[n],m_cIm[n]);
+        }
+        Complex c = sum / a[row][row];
+        m_cRe[row] = c.real();
+        m_cIm[row] = c.imag();
+    }
+    return true;
+}
+
+bool MultiFocus::solve(const _3DCor foci[], int count, const double weights[])
+{
+    if (count <= 0 || count > MULTIFOCUS_MAX)
+        return false;
+    m_count = count;
+    memcpy(m_foci,foci,count * sizeof(_3DCor));
+
+    run(STAGE_PROPAGATION);
+    for (int m=0;m<m_count;m++)
+    {
+        for (int n=m;n<m_count;n++)
+        {
+            double re = 0;
+            double im = 0;
+            for (int chunk=0;chunk<m_chunks.size();chunk++)
+            {
+                const double *part = m_gramParts.constData() + chunk * GRAM_SIZE;
+                re += part[(m * MULTIFOCUS_MAX + n) * 2];
+                im += part[(m * MULTIFOCUS_MAX + n) * 2 + 1];
+            }
+            m_gramRe[m][n] = re;
+            m_gramIm[m][n] = im;
+            m_gramRe[n][m] = re;
+            m_gramIm[n][m] = -im;
+        }
+    }
+
+    //  what each focus gets from every element at 1 and in phase
+    double reference[MULTIFOCUS_MAX];
+    double target[MULTIFOCUS_MAX];
+    double weight[MULTIFOCUS_MAX];
+    double pRe[MULTIFOCUS_MAX];
+    double pIm[MULTIFOCUS_MAX];
+    for (int focus=0;focus<m_count;focus++)
+    {
+        reference[focus] = 0;
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            reference[focus] += sqrt(m_hRe[focus][channel] * m_hRe[focus][channel] +
+                                     m_hIm[focus][channel] * m_hIm[focus][channel]);
+        }
+        target[focus] = (weights != 0 && weights[focus] > 0) ? weights[focus] : 1;
+        weight[focus] = target[focus];
+        pRe[focus] = target[focus];
+        pIm[focus] = 0;
+    }
+
+    for (int iteration=0;iteration<m_iterations;iteration++)
+    {
+        if (!solveSystem(pRe,pIm))
+            return false;
+        run(STAGE_DRIVE);
+
+        //  the elements cannot exceed full drive, the strongest sets the scale
+        double strongest = 0;
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            strongest = qMax(strongest,m_uRe[channel] * m_uRe[channel] +
+                                       m_uIm[channel] * m_uIm[channel]);
+        }
+        strongest = sqrt(strongest);
+        if (strongest == 0)
+            return false;
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            m_uRe[channel] /= strongest;
+            m_uIm[channel] /= strongest;
+        }
+
+        //  keep the phases the foci took, lift the ones falling behind
+        double relative[MULTIFOCUS_MAX] = {0};
+        double mean = 0;
+        for (int focus=0;focus<m_count;focus++)
+        {
+            double re = 0;
+            double im = 0;
+            for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+            {
+                re += m_hRe[focus][channel] * m_uRe[channel] - m_hIm[focus][channel] * m_uIm[channel];
+                im += m_hRe[focus][channel] * m_uIm[channel] + m_hIm[focus][channel] * m_uRe[channel];
+            }
+            double magnitude = sqrt(re * re + im * im);
+            m_pressure[focus] = magnitude / reference[focus];
+            relative[focus] = m_pressure[focus] / target[focus];
+            mean += relative[focus] / m_count;
+            pRe[focus] = (magnitude > 0) ? re / magnitude : 1;
+            pIm[focus] = (magnitude > 0) ? im / magnitude : 0;
+        }
+        double weakest = relative[0];
+        double strongestFocus = relative[0];
+        for (int focus=0;focus<m_count;focus++)
+        {
+            weakest = qMin(weakest,relative[focus]);
+            strongestFocus = qMax(strongestFocus,relative[focus]);
+            if (relative[focus] > 0)
+                weight[focus] *= mean / relative[focus];
+            pRe[focus] *= weight[focus];
+            pIm[focus] *= weight[focus];
+        }
+        m_uniformity = (strongestFocus > 0) ? weakest / strongestFocus : 0;
+    }
+
+    //  the delay of each element is its drive phase, as in PhaseEngine::focus()
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        double cycles = -atan2(m_uIm[channel],m_uRe[channel]) / TWO_PI;
+        double delay = (cycles - floor(cycles)) * PHASE_STEPS;
+        m_phases[channel] = (quint8)(lrint(delay) & (PHASE_STEPS - 1));
+        m_amplitudes[channel] = sqrt(m_uRe[channel] * m_uRe[channel] +
+                                     m_uIm[channel] * m_uIm[channel]);
+    }
+    return true;
+}
+
+void MultiFocus::volts(VOLT volt, VOLT out[TRANSDUCER_COUNT]) const
+{
+    volt = qBound(VOLT(0),volt,VOLT(VOLT_MAX));
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        out[channel] = volt * m_amplitudes[channel];
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef MULTIFOCUS_H
+#define MULTIFOCUS_H
+
+#include <QVector>
+
+#include "phaseengine.h"
+
+#define MULTIFOCUS_MAX 16
+#define MULTIFOCUS_ITERATIONS 8
+//  of the mean diagonal of H H^H, keeps close foci solvable
+#define MULTIFOCUS_REGULARIZATION 1e-3
+
+//  elements handed to one thread at a time
+typedef struct MultiFocusChunk
+{
+    class MultiFocus* solver;
+    int first;
+    int last;
+    int stage;
+}_MultiFocusChunk;
+
+//  Drive of every element for several foci at once. The minimum norm
+//  solution u = H^H (H H^H)^-1 p of the propagation matrix H is iterated
+//  on the phases and weights of the focal pressures p until the foci are
+//  as even as the array allows. The element loops can be split over the
+//  cores; the foci systems themselves are at most 16 x 16.
+class PHASEENGINESHARED_EXPORT MultiFocus
+{
+public:
+    MultiFocus(const PhaseEngine* engine);
+
+    //  split the element loops over threadCount threads of the global
+    //  QThreadPool, one per core by default; 0 or 1 runs them in the
+    //  calling thread. PhaseBenchmark times both for 1 ~ MULTIFOCUS_MAX foci
+    void setThreadCount(int threadCount);
+    inline int threadCount() const { return m_threadCount; }
+    inline void setIterations(int iterations) { m_iterations = qMax(1,iterations); }
+
+    //  weights are the wanted relative pressures, all 1 if omitted;
+    //  returns false for no focus or more than MULTIFOCUS_MAX
+    bool solve(const _3DCor foci[], int count, const double weights[] = 0);
+
+    //  phase bytes as PhaseEngine::focus() makes them
+    inline const quint8* phases() const { return m_phases; }
+    //  0 ~ 1, the strongest element at 1
+    inline const double* amplitudes() const { return m_amplitudes; }
+    //  per-channel drive for the power amplifiers, volt on the strongest
+    void volts(VOLT volt, VOLT out[TRANSDUCER_COUNT]) const;
+    //  pressure reached at each focus with the amplitudes above,
+    //  relative to all the elements at 1 focused on a single spot
+    inline double pressure(int focus) const { return m_pressure[focus]; }
+    //  weakest over strongest focus, relative to their weights
+    inline double uniformity() const { return m_uniformity; }
+
+    static void runChunk(MultiFocusChunk& chunk);
+
+private:
+    enum STAGE
+    {
+        //  H and the H H^H of the chunk
+        STAGE_PROPAGATION,
+        STAGE_DRIVE
+    };
+
+    const PhaseEngine *m_engine;
+    int m_threadCount;
+    int m_iterations;
+    int m_count;
+    //  H, row per focus, split in real and imaginary parts
+    double m_hRe[MULTIFOCUS_MAX][TRANSDUCER_COUNT];
+    double m_hIm[MULTIFOCUS_MAX][TRANSDUCER_COUNT];
+    //  H H^H accumulated per chunk, then summed
+    QVector<double> m_gramParts;
+    double m_gramRe[MULTIFOCUS_MAX][MULTIFOCUS_MAX];
+    double m_gramIm[MULTIFOCUS_MAX][MULTIFOCUS_MAX];
+    //  (H H^H)^-1 p
+    double m_cRe[MULTIFOCUS_MAX];
+    double m_cIm[MULTIFOCUS_MAX];
+    double m_uRe[TRANSDUCER_COUNT];
+    double m_uIm[TRANSDUCER_COUNT];
+    _3DCor m_foci[MULTIFOCUS_MAX];
+    QVector<MultiFocusChunk> m_chunks;
+
+    quint8 m_phases[TRANSDUCER_COUNT];
+    double m_amplitudes[TRANSDUCER_COUNT];
+    double m_pressure[MULTIFOCUS_MAX];
+    double m_uniformity;
+
+    void run(int stage);
+    void propagation(int first, int last);
+    void gram(int chunk, int first, int last);
+    void drive(int first, int last);
+    bool solveSystem(const double pRe[], const double pIm[]);
+};
+
+#endif // MULTIFOCUS_H
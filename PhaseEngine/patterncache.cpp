@@ -0,0 +1,131 @@
+#include <math.h>
+
+#include "patterncache.h"
+
+PatternCache::PatternCache(const PhaseEngine *engine, int capacity) :
+    m_engine(engine),
+    m_quantum(PATTERN_CACHE_QUANTUM),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0)
+{
+    setCapacity(capacity);
+}
+
+void PatternCache::setCapacity(int capacity)
+{
+    m_capacity = qMax(1,capacity);
+    m_arena.resize(m_capacity * TRANSDUCER_COUNT);
+    m_keys.resize(m_capacity);
+    m_previous.resize(m_capacity);
+    m_next.resize(m_capacity);
+    clear();
+}
+
+void PatternCache::setQuantum(double quantum)
+{
+    if (quantum > 0 && quantum != m_quantum)
+    {
+        m_quantum = quantum;
+        clear();
+    }
+}
+
+void PatternCache::clear()
+{
+    m_index.clear();
+    m_index.reserve(m_capacity);
+    m_head = -1;
+    m_tail = -1;
+    m_used = 0;
+}
+
+void PatternCache::resetStatistics()
+{
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}
+
+PatternKey PatternCache::key(const _3DCor &spot) const
+{
+    PatternKey key;
+    key.x = (qint32)lrint(spot.x / m_quantum);
+    key.y = (qint32)lrint(spot.y / m_quantum);
+    key.z = (qint32)lrint(spot.z / m_quantum);
+    key.version = m_engine->geometry().version();
+    key.wavelength = m_engine->wavelength();
+    return key;
+}
+
+void PatternCache::unlink(int slot)
+{
+    if (m_previous[slot] >= 0)
+        m_next[m_previous[slot]] = m_next[slot];
+    else
+        m_head = m_next[slot];
+    if (m_next[slot] >= 0)
+        m_previous[m_next[slot]] = m_previous[slot];
+    else
+        m_tail = m_previous[slot];
+}
+
+void PatternCache::pushFront(int slot)
+{
+    m_previous[slot] = -1;
+    m_next[slot] = m_head;
+    if (m_head >= 0)
+        m_previous[m_head] = slot;
+    m_head = slot;
+    if (m_tail < 0)
+        m_tail = slot;
+}
+
+const quint8* PatternCache::find(const _3DCor &spot) const
+{
+    QHash<PatternKey,int>::const_iterator found = m_index.constFind(key(spot));
+    if (found == m_index.constEnd())
+        return 0;
+    return m_arena.constData() + found.value() * TRANSDUCER_COUNT;
+}
+
+const quint8* PatternCache::pattern(const _3DCor &spot)
+{
+    PatternKey wanted = key(spot);
+    QHash<PatternKey,int>::const_iterator found = m_index.constFind(wanted);
+    if (found != m_index.constEnd())
+    {
+        int slot = found.value();
+        if (slot != m_head)
+        {
+            unlink(slot);
+            pushFront(slot);
+        }
+        m_hits++;
+        return m_arena.constData() + slot * TRANSDUCER_COUNT;
+    }
+
+    m_misses++;
+    int slot;
+    if (m_used < m_capacity)
+    {
+        slot = m_used++;
+    }else
+    {
+        slot = m_tail;
+        unlink(slot);
+        m_index.remove(m_keys[slot]);
+        m_evictions++;
+    }
+    //  on the quantized spot, so that a key always holds the same bytes
+    _3DCor quantized;
+    quantized.x = wanted.x * m_quantum;
+    quantized.y = wanted.y * m_quantum;
+    quantized.z = wanted.z * m_quantum;
+    quint8 *phases = m_arena.data() + slot * TRANSDUCER_COUNT;
+    m_engine->focus(quantized,phases);
+    m_keys[slot] = wanted;
+    m_index.insert(wanted,slot);
+    pushFront(slot);
+    return phases;
+}
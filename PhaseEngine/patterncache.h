@@ -0,0 +1,96 @@
+#ifndef PATTERNCACHE_H
+#define PATTERNCACHE_H
+
+#include <QHash>
+#include <QVector>
+
+#include "phaseengine.h"
+
+#define PATTERN_CACHE_CAPACITY 1024
+//  mm, spots closer than this share a pattern
+#define PATTERN_CACHE_QUANTUM 0.01
+
+//  a spot in quanta and the calibration its pattern was computed on
+typedef struct PatternKey
+{
+    qint32 x;
+    qint32 y;
+    qint32 z;
+    int version;
+    double wavelength;
+}_PatternKey;
+
+inline bool operator==(const PatternKey& a, const PatternKey& b)
+{
+    return a.x == b.x && a.y == b.y && a.z == b.z &&
+           a.version == b.version && a.wavelength == b.wavelength;
+}
+
+inline uint qHash(const PatternKey& key, uint seed = 0)
+{
+    uint hash = seed ^ uint(key.version);
+    hash = hash * 31 + uint(key.x);
+    hash = hash * 31 + uint(key.y);
+    hash = hash * 31 + uint(key.z);
+    return hash ^ qHash(key.wavelength);
+}
+
+//  Phase bytes of the spots visited last, ready for
+//  DOController::loadPattern(), so that a treatment plan passing the same
+//  spots again skips the computation. Only the phases are cached: the DO
+//  encoding depends on the state of the board, so DOController still
+//  builds it on every load (the samples, in buffered mode). The least
+//  recently used pattern makes room once capacity patterns are held. A
+//  new geometry or medium changes the key, the patterns of the old one
+//  simply age out.
+class PHASEENGINESHARED_EXPORT PatternCache
+{
+public:
+    PatternCache(const PhaseEngine* engine, int capacity = PATTERN_CACHE_CAPACITY);
+
+    //  drops every pattern; the statistics are kept
+    void setCapacity(int capacity);
+    inline int capacity() const { return m_capacity; }
+    inline int size() const { return m_index.size(); }
+    void setQuantum(double quantum);
+    inline double quantum() const { return m_quantum; }
+
+    //  the pattern of the quantized spot, computed on a miss; valid until
+    //  the next call
+    const quint8* pattern(const _3DCor& spot);
+    //  no computation, 0 on a miss, and no effect on the statistics
+    const quint8* find(const _3DCor& spot) const;
+    void clear();
+
+    inline qint64 hits() const { return m_hits; }
+    inline qint64 misses() const { return m_misses; }
+    inline qint64 evictions() const { return m_evictions; }
+    inline double hitRate() const { return (m_hits + m_misses > 0) ?
+                                           double(m_hits) / (m_hits + m_misses) : 0; }
+    void resetStatistics();
+
+private:
+    const PhaseEngine *m_engine;
+    int m_capacity;
+    double m_quantum;
+    //  slot of every key held
+    QHash<PatternKey,int> m_index;
+    //  per slot, TRANSDUCER_COUNT bytes each in one arena
+    QVector<quint8> m_arena;
+    QVector<PatternKey> m_keys;
+    //  use order, most recent at m_head, least recent at m_tail
+    QVector<int> m_previous;
+    QVector<int> m_next;
+    int m_head;
+    int m_tail;
+    int m_used;
+    qint64 m_hits;
+    qint64 m_misses;
+    qint64 m_evictions;
+
+    PatternKey key(const _3DCor& spot) const;
+    void unlink(int slot);
+    void pushFront(int slot);
+};
+
+#endif // PATTERNCACHE_H
@@ -0,0 +1,237 @@
+#include <QSettings>
+
+#include <math.h>
+
+#include "phaseengine.h"
+
+#ifdef PHASEENGINE_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+//  MSVC takes the intrinsics in any function
+#define AVX2_TARGET
+#else
+//  only these functions may use AVX2, the rest of a build without
+//  -mavx2 runs on any x86
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+//  the vector loop takes 16 elements per round
+Q_STATIC_ASSERT(TRANSDUCER_COUNT % 16 == 0);
+
+//  phase steps with 32 fraction bits
+#define FIXED_STEP_BITS 32
+//  the fixed-point path wraps the phase with the byte cast
+Q_STATIC_ASSERT(PHASE_STEPS == 256);
+
+PhaseEngine::PhaseEngine()
+{
+    setMedium(FREQUENCY_DEFAULT,SOUND_SPEED_DEFAULT);
+}
+
+void PhaseEngine::readSettings()
+{
+    QSettings* settings = new QSettings(SETTINGS_PATH,QSettings::IniFormat);
+    setMedium(settings->value("PhaseEngine/frequency",FREQUENCY_DEFAULT).toDouble(),
+              settings->value("PhaseEngine/soundSpeed",SOUND_SPEED_DEFAULT).toDouble());
+    delete settings;
+
+    m_geometry.readSettings();
+}
+
+void PhaseEngine::setMedium(double frequency, double soundSpeed)
+{
+    //  wavelength() divides by the frequency, a zero or negative one from
+    //  config.ini takes the default
+    m_frequency = (frequency > 0 && qIsFinite(frequency)) ? frequency : FREQUENCY_DEFAULT;
+    m_soundSpeed = (soundSpeed > 0 && qIsFinite(soundSpeed)) ? soundSpeed : SOUND_SPEED_DEFAULT;
+    m_waveNumber = (float)(1 / wavelength());
+    m_stepsFixed = (quint64)llrint(ldexp(PHASE_STEPS / (wavelength() * GEOMETRY_FIXED_UNIT),
+                                         FIXED_STEP_BITS));
+}
+
+#ifdef PHASEENGINE_AVX2
+static bool cpuHasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info,0);
+    if (info[0] < 7)
+        return false;
+    //  AVX, and the OS saving the YMM registers
+    __cpuid(info,1);
+    const int osxsaveAvx = (1 << 27) | (1 << 28);
+    if ((info[2] & osxsaveAvx) != osxsaveAvx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info,7,0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+bool PhaseEngine::simd()
+{
+#ifdef PHASEENGINE_AVX2
+    static const bool avx2 = cpuHasAvx2();
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+void PhaseEngine::focus(const _3DCor &spot, quint8 phases[TRANSDUCER_COUNT]) const
+{
+#ifdef PHASEENGINE_AVX2
+    if (simd())
+    {
+        focusAvx2(spot,phases);
+        return;
+    }
+#endif
+    focusScalar(spot,phases);
+}
+
+void PhaseEngine::focusScalar(const _3DCor &spot, quint8 phases[TRANSDUCER_COUNT]) const
+{
+    const float *x = m_geometry.x();
+    const float *y = m_geometry.y();
+    const float *z = m_geometry.z();
+    float sx = (float)spot.x;
+    float sy = (float)spot.y;
+    float sz = (float)spot.z;
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        float dx = x[channel] - sx;
+        float dy = y[channel] - sy;
+        float dz = z[channel] - sz;
+        float cycles = sqrtf(dx * dx + dy * dy + dz * dz) * m_waveNumber;
+        //  the farther the element, the earlier it fires
+        float delay = PHASE_STEPS - (cycles - floorf(cycles)) * PHASE_STEPS;
+        phases[channel] = (quint8)(lrintf(delay) & (PHASE_STEPS - 1));
+    }
+}
+
+float PhaseEngine::paths(const _3DCor &spot, float path[TRANSDUCER_COUNT]) const
+{
+#ifdef PHASEENGINE_AVX2
+    if (simd())
+        return pathsAvx2(spot,path);
+#endif
+    const float *x = m_geometry.x();
+    const float *y = m_geometry.y();
+    const float *z = m_geometry.z();
+    float sx = (float)spot.x;
+    float sy = (float)spot.y;
+    float sz = (float)spot.z;
+    float shortest = HUGE_VALF;
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        float dx = x[channel] - sx;
+        float dy = y[channel] - sy;
+        float dz = z[channel] - sz;
+        path[channel] = sqrtf(dx * dx + dy * dy + dz * dz);
+        shortest = qMin(shortest,path[channel]);
+    }
+    return shortest;
+}
+
+void PhaseEngine::focusFixed(const _3DCor &spot, quint8 phases[TRANSDUCER_COUNT]) const
+{
+    const qint32 *x = m_geometry.xFixed();
+    const qint32 *y = m_geometry.yFixed();
+    const qint32 *z = m_geometry.zFixed();
+    qint64 sx = llrint(spot.x * GEOMETRY_FIXED_UNIT);
+    qint64 sy = llrint(spot.y * GEOMETRY_FIXED_UNIT);
+    qint64 sz = llrint(spot.z * GEOMETRY_FIXED_UNIT);
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        qint64 dx = x[channel] - sx;
+        qint64 dy = y[channel] - sy;
+        qint64 dz = z[channel] - sz;
+        //  below 2^53 for any path under 5 m, exact as a double; the root
+        //  it gives is off by at most one and set right in integers, so it
+        //  is the exact integer root whatever the FPU rounded
+        qint64 square = dx * dx + dy * dy + dz * dz;
+        qint64 path = (qint64)sqrt((double)square);
+        path -= (path * path > square);
+        path += ((path + 1) * (path + 1) <= square);
+        //  to the nearest rather than down
+        path += (square - path * path > path);
+        //  minus the steps rounded, modulo PHASE_STEPS, as focusScalar()
+        quint64 delay = (Q_UINT64_C(1) << (FIXED_STEP_BITS - 1)) - (quint64)path * m_stepsFixed;
+        phases[channel] = (quint8)(delay >> FIXED_STEP_BITS);
+    }
+}
+
+#ifdef PHASEENGINE_AVX2
+AVX2_TARGET void PhaseEngine::focusAvx2(const _3DCor &spot, quint8 phases[TRANSDUCER_COUNT]) const
+{
+    const float *x = m_geometry.x();
+    const float *y = m_geometry.y();
+    const float *z = m_geometry.z();
+    const __m256 sx = _mm256_set1_ps((float)spot.x);
+    const __m256 sy = _mm256_set1_ps((float)spot.y);
+    const __m256 sz = _mm256_set1_ps((float)spot.z);
+    const __m256 waveNumber = _mm256_set1_ps(m_waveNumber);
+    const __m256 steps = _mm256_set1_ps((float)PHASE_STEPS);
+    const __m256i mask = _mm256_set1_epi32(PHASE_STEPS - 1);
+
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel+=16)
+    {
+        __m256i delays[2];
+        for (int half=0;half<2;half++)
+        {
+            int first = channel + half * 8;
+            __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + first),sx);
+            __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + first),sy);
+            __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + first),sz);
+            __m256 square = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx,dx),
+                                                        _mm256_mul_ps(dy,dy)),
+                                          _mm256_mul_ps(dz,dz));
+            __m256 cycles = _mm256_mul_ps(_mm256_sqrt_ps(square),waveNumber);
+            __m256 fraction = _mm256_sub_ps(cycles,_mm256_floor_ps(cycles));
+            __m256 delay = _mm256_sub_ps(steps,_mm256_mul_ps(fraction,steps));
+            delays[half] = _mm256_and_si256(_mm256_cvtps_epi32(delay),mask);
+        }
+        //  32 -> 16 bits packs within the 128-bit lanes, put them back in order
+        __m256i words = _mm256_packus_epi32(delays[0],delays[1]);
+        words = _mm256_permute4x64_epi64(words,_MM_SHUFFLE(3,1,2,0));
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words),
+                                         _mm256_extracti128_si256(words,1));
+        _mm_storeu_si128((__m128i*)(phases + channel),bytes);
+    }
+}
+
+AVX2_TARGET float PhaseEngine::pathsAvx2(const _3DCor &spot, float path[TRANSDUCER_COUNT]) const
+{
+    const float *x = m_geometry.x();
+    const float *y = m_geometry.y();
+    const float *z = m_geometry.z();
+    const __m256 sx = _mm256_set1_ps((float)spot.x);
+    const __m256 sy = _mm256_set1_ps((float)spot.y);
+    const __m256 sz = _mm256_set1_ps((float)spot.z);
+    __m256 shortest = _mm256_set1_ps(HUGE_VALF);
+
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel+=8)
+    {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + channel),sx);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + channel),sy);
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + channel),sz);
+        __m256 square = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx,dx),
+                                                    _mm256_mul_ps(dy,dy)),
+                                      _mm256_mul_ps(dz,dz));
+        __m256 distance = _mm256_sqrt_ps(square);
+        _mm256_storeu_ps(path + channel,distance);
+        shortest = _mm256_min_ps(shortest,distance);
+    }
+    //  the minimum of the eight lanes
+    __m128 lanes = _mm_min_ps(_mm256_castps256_ps128(shortest),_mm256_extractf128_ps(shortest,1));
+    lanes = _mm_min_ps(lanes,_mm_movehl_ps(lanes,lanes));
+    lanes = _mm_min_ss(lanes,_mm_shuffle_ps(lanes,lanes,1));
+    return _mm_cvtss_f32(lanes);
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef PHASEENGINE_H
+#define PHASEENGINE_H
+
+#include "arraygeometry.h"
+
+//  the AVX2 loops are built on x86 whatever the compiler flags, and run
+//  if the CPU has AVX2
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PHASEENGINE_AVX2
+#endif
+
+//  Phase bytes for DOController from the array geometry: every element
+//  is delayed so that all the waves reach the focal spot in phase.
+//  A byte is the delay of the element in 1/PHASE_STEPS of the period.
+class PHASEENGINESHARED_EXPORT PhaseEngine
+{
+public:
+    PhaseEngine();
+
+    //  PhaseEngine/frequency and PhaseEngine/soundSpeed, and the geometry
+    void readSettings();
+    //  Hz and m/s
+    void setMedium(double frequency, double soundSpeed);
+    inline double frequency() const { return m_frequency; }
+    inline double soundSpeed() const { return m_soundSpeed; }
+    //  mm
+    inline double wavelength() const { return MM_UNIT * m_soundSpeed / m_frequency; }
+    inline ArrayGeometry& geometry() { return m_geometry; }
+    inline const ArrayGeometry& geometry() const { return m_geometry; }
+
+    //  AVX2 when the CPU has it, else focusScalar()
+    void focus(const _3DCor& spot, quint8 phases[TRANSDUCER_COUNT]) const;
+    void focusScalar(const _3DCor& spot, quint8 phases[TRANSDUCER_COUNT]) const;
+    //  integer arithmetic on the geometry and the spot in 1/16 um: the
+    //  same bytes from every compiler and instruction set
+    void focusFixed(const _3DCor& spot, quint8 phases[TRANSDUCER_COUNT]) const;
+    //  mm from spot to every element into path, returns the shortest;
+    //  AVX2 when the CPU has it
+    float paths(const _3DCor& spot, float path[TRANSDUCER_COUNT]) const;
+    //  the CPU has AVX2, checked once
+    static bool simd();
+
+private:
+    ArrayGeometry m_geometry;
+    double m_frequency;
+    double m_soundSpeed;
+    //  cycles per mm
+    float m_waveNumber;
+    //  phase steps per GEOMETRY_FIXED_UNIT of path, 32 fraction bits
+    quint64 m_stepsFixed;
+#ifdef PHASEENGINE_AVX2
+    void focusAvx2(const _3DCor& spot, quint8 phases[TRANSDUCER_COUNT]) const;
+    float pathsAvx2(const _3DCor& spot, float path[TRANSDUCER_COUNT]) const;
+#endif
+};
+
+#endif // PHASEENGINE_H
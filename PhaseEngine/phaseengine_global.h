@@ -0,0 +1,12 @@
+#ifndef PHASEENGINE_GLOBAL_H
+#define PHASEENGINE_GLOBAL_H
+
+#include <QtCore/qglobal.h>
+
+#if defined(PHASEENGINE_LIBRARY)
+#  define PHASEENGINESHARED_EXPORT Q_DECL_EXPORT
+#else
+#  define PHASEENGINESHARED_EXPORT Q_DECL_IMPORT
+#endif
+
+#endif // PHASEENGINE_GLOBAL_H
@@ -0,0 +1,225 @@
+#include <QSettings>
+
+#include <math.h>
+#include <string.h>
+
+#include "steeringgrid.h"
+
+#define GRID_WEIGHT_BITS 7
+#define GRID_WEIGHT_ONE (1 << GRID_WEIGHT_BITS)
+
+//  points on both sides of the natural focus and on it, in double so
+//  that a range from the settings cannot overflow
+static double axisCount(double range, double step)
+{
+    return 2 * floor(range / step) + 1;
+}
+
+static int circularDistance(quint8 a, quint8 b)
+{
+    int difference = qAbs(int(a) - int(b));
+    return qMin(difference,PHASE_STEPS - difference);
+}
+
+SteeringGrid::SteeringGrid(const PhaseEngine *engine) :
+    m_engine(engine),
+    m_version(-1),
+    m_wavelength(0)
+{
+    _3DCor range;
+    range.x = GRID_RANGE_XY;
+    range.y = GRID_RANGE_XY;
+    range.z = GRID_RANGE_Z;
+    setGrid(range,GRID_STEP);
+}
+
+void SteeringGrid::readSettings()
+{
+    QSettings* settings = new QSettings(SETTINGS_PATH,QSettings::IniFormat);
+    _3DCor range;
+    range.x = settings->value("SteeringGrid/rangeX",GRID_RANGE_XY).toDouble();
+    range.y = settings->value("SteeringGrid/rangeY",GRID_RANGE_XY).toDouble();
+    range.z = settings->value("SteeringGrid/rangeZ",GRID_RANGE_Z).toDouble();
+    double step = settings->value("SteeringGrid/step",GRID_STEP).toDouble();
+    delete settings;
+
+    setGrid(range,step);
+}
+
+void SteeringGrid::setGrid(const _3DCor &range, double step)
+{
+    m_step = (step > 0 && qIsFinite(step)) ? step : GRID_STEP;
+    m_range.x = qIsFinite(range.x) ? qMax(0.0,range.x) : 0;
+    m_range.y = qIsFinite(range.y) ? qMax(0.0,range.y) : 0;
+    m_range.z = qIsFinite(range.z) ? qMax(0.0,range.z) : 0;
+    //  coarser until the table fits GRID_POINTS_MAX
+    double points = 0;
+    while ((points = axisCount(m_range.x,m_step) * axisCount(m_range.y,m_step) *
+                     axisCount(m_range.z,m_step)) > GRID_POINTS_MAX)
+    {
+        m_step *= qMax(1.01,cbrt(points / GRID_POINTS_MAX));
+    }
+    m_count[0] = (int)axisCount(m_range.x,m_step);
+    m_count[1] = (int)axisCount(m_range.y,m_step);
+    m_count[2] = (int)axisCount(m_range.z,m_step);
+    m_range.x = (m_count[0] - 1) / 2 * m_step;
+    m_range.y = (m_count[1] - 1) / 2 * m_step;
+    m_range.z = (m_count[2] - 1) / 2 * m_step;
+    m_table.clear();
+}
+
+void SteeringGrid::build()
+{
+    m_table.resize(pointCount() * TRANSDUCER_COUNT);
+    quint8 *pattern = m_table.data();
+    for (int k=0;k<m_count[2];k++)
+    {
+        for (int j=0;j<m_count[1];j++)
+        {
+            for (int i=0;i<m_count[0];i++)
+            {
+                _3DCor spot;
+                spot.x = i * m_step - m_range.x;
+                spot.y = j * m_step - m_range.y;
+                spot.z = k * m_step - m_range.z;
+                m_engine->focus(spot,pattern);
+                pattern += TRANSDUCER_COUNT;
+            }
+        }
+    }
+    m_version = m_engine->geometry().version();
+    m_wavelength = m_engine->wavelength();
+}
+
+bool SteeringGrid::locate(const _3DCor &spot, double cell[]) const
+{
+    //  a table of the old geometry or medium would focus elsewhere
+    if (!isBuilt() || isStale())
+        return false;
+    cell[0] = (spot.x + m_range.x) / m_step;
+    cell[1] = (spot.y + m_range.y) / m_step;
+    cell[2] = (spot.z + m_range.z) / m_step;
+    for (int axis=0;axis<3;axis++)
+    {
+        if (cell[axis] < 0 || cell[axis] > m_count[axis] - 1)
+            return false;
+    }
+    return true;
+}
+
+bool SteeringGrid::nearest(const _3DCor &spot, quint8 phases[TRANSDUCER_COUNT]) const
+{
+    double cell[3];
+    if (!locate(spot,cell))
+        return false;
+    memcpy(phases,pattern((int)lrint(cell[0]),(int)lrint(cell[1]),(int)lrint(cell[2])),
+           TRANSDUCER_COUNT);
+    return true;
+}
+
+bool SteeringGrid::interpolated(const _3DCor &spot, quint8 phases[TRANSDUCER_COUNT]) const
+{
+    double cell[3];
+    if (!locate(spot,cell))
+        return false;
+
+    int lower[3];
+    float fraction[3];
+    for (int axis=0;axis<3;axis++)
+    {
+        //  the last point belongs to the cell below it
+        lower[axis] = qMin((int)cell[axis],qMax(m_count[axis] - 2,0));
+        fraction[axis] = (m_count[axis] > 1) ? (float)(cell[axis] - lower[axis]) : 0;
+    }
+    //  weights in 1/GRID_WEIGHT_ONE, so that the channel loop is integer
+    const quint8 *corners[8];
+    int weights[8];
+    for (int corner=0;corner<8;corner++)
+    {
+        int i = lower[0] + ((corner & 1) && m_count[0] > 1);
+        int j = lower[1] + ((corner & 2) && m_count[1] > 1);
+        int k = lower[2] + ((corner & 4) && m_count[2] > 1);
+        corners[corner] = pattern(i,j,k);
+        weights[corner] = (int)lrintf(((corner & 1) ? fraction[0] : 1 - fraction[0]) *
+                                      ((corner & 2) ? fraction[1] : 1 - fraction[1]) *
+                                      ((corner & 4) ? fraction[2] : 1 - fraction[2]) *
+                                      GRID_WEIGHT_ONE);
+    }
+
+    //  offsets from the first corner wrap to -128 ~ 127, so that 255 and 1
+    //  blend to 0 rather than to 128; corner by corner, the channel loops
+    //  vectorize
+    const quint8 *base = corners[0];
+    qint16 offsets[TRANSDUCER_COUNT];
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        offsets[channel] = GRID_WEIGHT_ONE / 2;
+    }
+    for (int corner=1;corner<8;corner++)
+    {
+        const quint8 *other = corners[corner];
+        qint16 weight = weights[corner];
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            offsets[channel] += (qint16)(weight * (qint8)(quint8)(other[channel] - base[channel]));
+        }
+    }
+    for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+    {
+        phases[channel] = (quint8)(base[channel] + (offsets[channel] >> GRID_WEIGHT_BITS));
+    }
+    return true;
+}
+
+SteeringError SteeringGrid::error(int samples) const
+{
+    SteeringError error;
+    memset(&error,0,sizeof(error));
+    //  half the cell diagonal, no path length changes faster than the spot;
+    //  plus a rounding of the stored and one of the exact byte
+    error.boundNearest = sqrt(3.0) / 2 * m_step / m_engine->wavelength() * PHASE_STEPS + 1;
+    if (!isBuilt() || isStale())
+        return error;
+
+    quint8 exact[TRANSDUCER_COUNT];
+    quint8 looked[TRANSDUCER_COUNT];
+    qint64 totalNearest = 0;
+    qint64 totalInterpolated = 0;
+    quint32 seed = 1;
+    for (int sample=0;sample<samples;sample++)
+    {
+        double offset[3];
+        for (int axis=0;axis<3;axis++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            offset[axis] = (seed >> 8) / double(1 << 24) * 2 - 1;
+        }
+        _3DCor spot;
+        spot.x = offset[0] * m_range.x;
+        spot.y = offset[1] * m_range.y;
+        spot.z = offset[2] * m_range.z;
+        m_engine->focus(spot,exact);
+
+        nearest(spot,looked);
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            int steps = circularDistance(exact[channel],looked[channel]);
+            totalNearest += steps;
+            error.maxNearest = qMax(error.maxNearest,steps);
+        }
+        interpolated(spot,looked);
+        for (int channel=0;channel<TRANSDUCER_COUNT;channel++)
+        {
+            int steps = circularDistance(exact[channel],looked[channel]);
+            totalInterpolated += steps;
+            error.maxInterpolated = qMax(error.maxInterpolated,steps);
+        }
+    }
+    error.samples = samples;
+    if (samples > 0)
+    {
+        error.meanNearest = double(totalNearest) / (qint64(samples) * TRANSDUCER_COUNT);
+        error.meanInterpolated = double(totalInterpolated) / (qint64(samples) * TRANSDUCER_COUNT);
+    }
+    return error;
+}
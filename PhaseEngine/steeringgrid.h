@@ -0,0 +1,70 @@
+#ifndef STEERINGGRID_H
+#define STEERINGGRID_H
+
+#include <QVector>
+
+#include "phaseengine.h"
+
+//  how far a lookup strays from PhaseEngine::focus(), in phase steps
+typedef struct SteeringError
+{
+    int samples;
+    //  over every channel of every sample
+    double meanNearest;
+    int maxNearest;
+    double meanInterpolated;
+    int maxInterpolated;
+    //  a nearest lookup is never further off than this
+    double boundNearest;
+}_SteeringError;
+
+//  Phase patterns computed ahead over a box around the natural focus,
+//  TRANSDUCER_COUNT bytes per grid point in one contiguous table, so that
+//  a spot costs a copy (nearest) or a blend of 8 patterns (interpolated)
+//  instead of a phase computation.
+class PHASEENGINESHARED_EXPORT SteeringGrid
+{
+public:
+    SteeringGrid(const PhaseEngine* engine);
+
+    //  SteeringGrid/rangeX, rangeY, rangeZ (half widths) and step, in mm
+    void readSettings();
+    //  the step grows if the grid would exceed GRID_POINTS_MAX points
+    void setGrid(const _3DCor& range, double step);
+    //  fills the table from the engine, again after the geometry or the
+    //  medium changed
+    void build();
+    inline bool isBuilt() const { return !m_table.isEmpty(); }
+    inline bool isStale() const { return m_version != m_engine->geometry().version() ||
+                                         m_wavelength != m_engine->wavelength(); }
+    inline double step() const { return m_step; }
+    inline int pointCount() const { return m_count[0] * m_count[1] * m_count[2]; }
+    inline int bytes() const { return m_table.size(); }
+
+    //  false outside the grid or when stale, the caller then computes the
+    //  spot
+    bool nearest(const _3DCor& spot, quint8 phases[TRANSDUCER_COUNT]) const;
+    //  trilinear between the 8 surrounding points, each channel blended
+    //  the short way round the phase circle
+    bool interpolated(const _3DCor& spot, quint8 phases[TRANSDUCER_COUNT]) const;
+
+    //  both lookups against the exact computation on samples spots
+    SteeringError error(int samples) const;
+
+private:
+    const PhaseEngine *m_engine;
+    _3DCor m_range;
+    double m_step;
+    int m_count[3];
+    QVector<quint8> m_table;
+    int m_version;
+    double m_wavelength;
+    inline const quint8* pattern(int i, int j, int k) const
+    {
+        return m_table.constData() +
+               ((k * m_count[1] + j) * m_count[0] + i) * TRANSDUCER_COUNT;
+    }
+    bool locate(const _3DCor& spot, double cell[3]) const;
+};
+
+#endif // STEERINGGRID_H
@@ -14,10 +14,19 @@ DEFINES += POWERAMP_LIBRARY
 
 INCLUDEPATH += ../lib/common
 
-SOURCES += poweramp.cpp
+SOURCES += poweramp.cpp \
+    busprofiler.cpp \
+    framepacer.cpp \
+    framecapture.cpp \
+    pasimulator.cpp
 
 HEADERS += poweramp.h\
-        poweramp_global.h
+        poweramp_global.h \
+    busprofiler.h \
+    framepacer.h \
+    framecapture.h \
+    pasimulator.h \
+    sweepresult.h
 
 unix {
     target.path = /usr/lib
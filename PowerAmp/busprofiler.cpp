@@ -0,0 +1,107 @@
+#include "busprofiler.h"
+#include "constant.h"
+
+BusProfiler::BusProfiler() :
+    m_enabled(false),
+    m_baudRate(9600),
+    m_bitsPerByte(10)
+{
+    reset();
+}
+
+void BusProfiler::setLine(qint32 baudRate, int bitsPerByte)
+{
+    m_baudRate = baudRate > 0 ? baudRate : m_baudRate;
+    m_bitsPerByte = bitsPerByte > 0 ? bitsPerByte : m_bitsPerByte;
+}
+
+void BusProfiler::reset()
+{
+    m_txBytes = 0;
+    m_rxBytes = 0;
+    m_txFrames = 0;
+    m_lastRxNs = -1;
+    m_gapCount = 0;
+    m_gapTotalNs = 0;
+    m_gapMaxNs = 0;
+    m_clock.start();
+}
+
+void BusProfiler::transmitted(qint64 bytes)
+{
+    if (!m_enabled || bytes <= 0)
+        return;
+
+    qint64 now = m_clock.nsecsElapsed();
+    if (m_lastRxNs >= 0)
+    {
+        qint64 gap = now - m_lastRxNs;
+        m_gapCount++;
+        m_gapTotalNs += gap;
+        m_gapMaxNs = gap > m_gapMaxNs ? gap : m_gapMaxNs;
+        m_lastRxNs = -1;
+    }
+    m_txBytes += bytes;
+    m_txFrames++;
+}
+
+void BusProfiler::received(qint64 bytes)
+{
+    if (!m_enabled || bytes <= 0)
+        return;
+
+    m_rxBytes += bytes;
+    m_lastRxNs = m_clock.nsecsElapsed();
+}
+
+qint64 BusProfiler::meanGapNs() const
+{
+    return m_gapCount ? m_gapTotalNs / m_gapCount : 0;
+}
+
+qint64 BusProfiler::elapsedNs() const
+{
+    return m_clock.nsecsElapsed();
+}
+
+qint64 BusProfiler::idleNs() const
+{
+    qint64 idle = elapsedNs() - wireNs(m_txBytes + m_rxBytes);
+    return idle > 0 ? idle : 0;
+}
+
+double BusProfiler::framesPerSecond() const
+{
+    qint64 elapsed = elapsedNs();
+    return elapsed > 0 ? double(m_txFrames) * 1e9 / double(elapsed) : 0;
+}
+
+double BusProfiler::utilization() const
+{
+    qint64 elapsed = elapsedNs();
+    return elapsed > 0 ? double(wireNs(m_txBytes + m_rxBytes)) / double(elapsed) : 0;
+}
+
+double BusProfiler::capacityFramesPerSecond(int frameBytes) const
+{
+    //  every request is answered by an echo of the same length
+    return double(m_baudRate) / double(m_bitsPerByte * frameBytes * 2);
+}
+
+QString BusProfiler::summary() const
+{
+    return QString("tx %1 B, rx %2 B, %3 frames, %4 fps of %5 fps capacity, "
+                   "utilization %6 %, idle %7 ms, turnaround mean %8 us max %9 us")
+            .arg(m_txBytes).arg(m_rxBytes).arg(m_txFrames)
+            .arg(framesPerSecond(),0,'f',1)
+            .arg(capacityFramesPerSecond(FRAME_SIZE),0,'f',1)
+            .arg(utilization() * PERCENT_UNIT,0,'f',1)
+            .arg(idleNs() / 1000000)
+            .arg(meanGapNs() / 1000)
+            .arg(m_gapMaxNs / 1000);
+}
+
+qint64 BusProfiler::wireNs(qint64 bytes) const
+{
+    return bytes * m_bitsPerByte * Q_INT64_C(1000000000) / m_baudRate;
+}
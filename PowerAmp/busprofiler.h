@@ -0,0 +1,63 @@
+#ifndef BUSPROFILER_H
+#define BUSPROFILER_H
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include "poweramp_global.h"
+
+//  Accounting of the traffic on the power amplifier bus.
+//  The wire time of every byte is derived from the line settings,
+//  so the achieved rates can be compared with the link capacity.
+class POWERAMPSHARED_EXPORT BusProfiler
+{
+public:
+    BusProfiler();
+
+    //  bitsPerByte = start + data + parity + stop bits
+    void setLine(qint32 baudRate, int bitsPerByte);
+    inline void setEnabled(bool enabled) { m_enabled = enabled; }
+    inline bool isEnabled() const { return m_enabled; }
+    void reset();
+
+    //  called right after a frame was written / bytes were read
+    void transmitted(qint64 bytes);
+    void received(qint64 bytes);
+
+    inline qint64 bytesTransmitted() const { return m_txBytes; }
+    inline qint64 bytesReceived() const { return m_rxBytes; }
+    inline qint64 framesTransmitted() const { return m_txFrames; }
+    inline qint64 turnarounds() const { return m_gapCount; }
+    //  gaps between the last received byte and the next transmitted frame
+    inline qint64 maxGapNs() const { return m_gapMaxNs; }
+    qint64 meanGapNs() const;
+
+    qint64 elapsedNs() const;
+    //  time the line carried no bits within the elapsed window
+    qint64 idleNs() const;
+    double framesPerSecond() const;
+    //  share of the baud rate used by both directions, 0 ~ 1
+    double utilization() const;
+    //  frames per second of a request/echo exchange at full line rate
+    double capacityFramesPerSecond(int frameBytes) const;
+
+    QString summary() const;
+
+private:
+    bool m_enabled;
+    qint32 m_baudRate;
+    int m_bitsPerByte;
+
+    QElapsedTimer m_clock;
+    qint64 m_txBytes;
+    qint64 m_rxBytes;
+    qint64 m_txFrames;
+    qint64 m_lastRxNs;
+    qint64 m_gapCount;
+    qint64 m_gapTotalNs;
+    qint64 m_gapMaxNs;
+
+    qint64 wireNs(qint64 bytes) const;
+};
+
+#endif // BUSPROFILER_H
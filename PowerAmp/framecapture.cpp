@@ -0,0 +1,142 @@
+#include <QDateTime>
+
+#include <string.h>
+
+#include "framecapture.h"
+
+FrameCapture::FrameCapture() :
+    m_sequence(0)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+    close();
+}
+
+bool FrameCapture::open(const QString &fileName, qint32 baudRate, int bitsPerByte)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    CaptureHeader header;
+    memset(&header,0,sizeof(header));
+    header.magic = CAPTURE_MAGIC;
+    header.version = CAPTURE_VERSION;
+    header.recordSize = sizeof(FrameRecord);
+    header.baudRate = baudRate;
+    header.bitsPerByte = bitsPerByte;
+    header.startEpochMs = QDateTime::currentMSecsSinceEpoch();
+
+    if (m_file.write((const char*)&header,sizeof(header)) != sizeof(header))
+    {
+        m_file.close();
+        return false;
+    }
+    m_sequence = 0;
+    m_clock.start();
+    return true;
+}
+
+void FrameCapture::close()
+{
+    if (m_file.isOpen())
+    {
+        m_file.flush();
+        m_file.close();
+    }
+}
+
+void FrameCapture::record(DIRECTION direction, const QByteArray &data)
+{
+    if (!isOpen())
+        return;
+
+    FrameRecord frame;
+    frame.timestampNs = m_clock.nsecsElapsed();
+    frame.direction = direction;
+    frame.reserved = 0;
+
+    for (int offset=0;offset<data.size();offset+=CAPTURE_DATA_SIZE)
+    {
+        int length = qMin(data.size() - offset,CAPTURE_DATA_SIZE);
+        memset(frame.data,0,CAPTURE_DATA_SIZE);
+        memcpy(frame.data,data.constData() + offset,length);
+        frame.length = length;
+        frame.sequence = m_sequence++;
+        m_file.write((const char*)&frame,sizeof(frame));
+    }
+}
+
+FrameCaptureReader::FrameCaptureReader() :
+    m_map(NULL),
+    m_header(NULL),
+    m_records(NULL),
+    m_count(0)
+{
+}
+
+FrameCaptureReader::~FrameCaptureReader()
+{
+    close();
+}
+
+bool FrameCaptureReader::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < (qint64)sizeof(CaptureHeader))
+    {
+        close();
+        return false;
+    }
+
+    m_map = m_file.map(0,m_file.size());
+    if (m_map == NULL)
+    {
+        close();
+        return false;
+    }
+
+    m_header = (const CaptureHeader*)m_map;
+    if (m_header->magic != CAPTURE_MAGIC ||
+        m_header->version != CAPTURE_VERSION ||
+        m_header->recordSize != sizeof(FrameRecord) ||
+        m_header->baudRate == 0)
+    {
+        close();
+        return false;
+    }
+
+    m_records = (const FrameRecord*)(m_map + sizeof(CaptureHeader));
+    //  a record cut short by a crash is ignored
+    m_count = (m_file.size() - sizeof(CaptureHeader)) / sizeof(FrameRecord);
+    //  a length past the data would send readers beyond the record
+    for (qint64 i=0;i<m_count;i++)
+    {
+        if (m_records[i].length > CAPTURE_DATA_SIZE)
+        {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void FrameCaptureReader::close()
+{
+    if (m_map != NULL)
+    {
+        m_file.unmap(m_map);
+        m_map = NULL;
+    }
+    if (m_file.isOpen())
+    {
+        m_file.close();
+    }
+    m_header = NULL;
+    m_records = NULL;
+    m_count = 0;
+}
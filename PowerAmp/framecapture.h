@@ -0,0 +1,95 @@
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <QFile>
+#include <QElapsedTimer>
+#include <QString>
+
+#include "poweramp_global.h"
+
+//  Binary capture of the serial frames, the packed structs below in host
+//  byte order (a reader of the other order fails on the magic), fixed-size
+//  records so that a capture file can be memory-mapped and indexed directly:
+//
+//      CaptureHeader | FrameRecord | FrameRecord | ...
+
+#define CAPTURE_MAGIC 0x50434150    //  "PACP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_DATA_SIZE 16
+
+#pragma pack(push,1)
+typedef struct CaptureHeader
+{
+    quint32 magic;
+    quint16 version;
+    quint16 recordSize;
+    quint32 baudRate;
+    quint8 bitsPerByte;
+    quint8 reserved[3];
+    //  wall clock when the capture was opened, ms since epoch
+    qint64 startEpochMs;
+    quint64 reserved2;
+}_CapHeader;
+
+typedef struct FrameRecord
+{
+    //  monotonic, from the start of the capture
+    quint64 timestampNs;
+    quint8 direction;
+    quint8 length;
+    quint16 reserved;
+    quint32 sequence;
+    quint8 data[CAPTURE_DATA_SIZE];
+}_FrameRecord;
+#pragma pack(pop)
+
+class POWERAMPSHARED_EXPORT FrameCapture
+{
+public:
+    enum DIRECTION
+    {
+        TX,
+        RX
+    };
+
+    FrameCapture();
+    ~FrameCapture();
+
+    bool open(const QString& fileName, qint32 baudRate, int bitsPerByte);
+    void close();
+    inline bool isOpen() const { return m_file.isOpen(); }
+
+    //  chunks longer than CAPTURE_DATA_SIZE are split over several records
+    void record(DIRECTION direction, const QByteArray& data);
+
+private:
+    QFile m_file;
+    QElapsedTimer m_clock;
+    quint32 m_sequence;
+};
+
+//  read-only view of a capture file, the records are mapped, not copied
+class POWERAMPSHARED_EXPORT FrameCaptureReader
+{
+public:
+    FrameCaptureReader();
+    ~FrameCaptureReader();
+
+    //  false for another format version, a zero baud rate or a record
+    //  claiming more than CAPTURE_DATA_SIZE bytes
+    bool open(const QString& fileName);
+    void close();
+
+    inline const CaptureHeader* header() const { return m_header; }
+    inline const FrameRecord* records() const { return m_records; }
+    inline qint64 count() const { return m_count; }
+
+private:
+    QFile m_file;
+    uchar* m_map;
+    const CaptureHeader* m_header;
+    const FrameRecord* m_records;
+    qint64 m_count;
+};
+
+#endif // FRAMECAPTURE_H
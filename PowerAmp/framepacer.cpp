@@ -0,0 +1,68 @@
+#include <QThread>
+
+#include "framepacer.h"
+
+#define NS_UNIT Q_INT64_C(1000000000)
+//  longest sleep between two looks at the deadline
+#define PACER_SLICE_US 1000
+
+FramePacer::FramePacer() :
+    m_rate(0),
+    m_burst(0),
+    m_tokens(0),
+    m_lastNs(0),
+    m_waitNs(0)
+{
+    m_clock.start();
+}
+
+void FramePacer::configure(qint64 rate, qint64 burst)
+{
+    m_rate = rate > 0 ? rate : 0;
+    m_burst = burst > 0 ? burst : 1;
+    //  start with a full bucket
+    m_tokens = m_burst * NS_UNIT;
+    m_lastNs = m_clock.nsecsElapsed();
+    m_waitNs = 0;
+}
+
+void FramePacer::refill()
+{
+    qint64 now = m_clock.nsecsElapsed();
+    qint64 full = m_burst * NS_UNIT;
+    //  compare before multiplying, a long idle period would overflow
+    m_tokens = (now - m_lastNs) >= (full - m_tokens) / m_rate + 1 ?
+                full : m_tokens + (now - m_lastNs) * m_rate;
+    m_lastNs = now;
+}
+
+qint64 FramePacer::acquire(qint64 bytes, const Deadline &deadline)
+{
+    if (!isEnabled())
+        return 0;
+
+    //  a frame larger than the bucket only waits for a full bucket
+    qint64 need = (bytes < m_burst ? bytes : m_burst) * NS_UNIT;
+    qint64 start = m_clock.nsecsElapsed();
+
+    refill();
+    while (m_tokens < need)
+    {
+        if (deadline.reached())
+        {
+            m_waitNs += m_clock.nsecsElapsed() - start;
+            return -1;
+        }
+        qint64 waitUs = qMin((need - m_tokens) / m_rate / 1000,(qint64)PACER_SLICE_US);
+        if (waitUs > 0)
+            QThread::usleep((unsigned long)waitUs);
+        else
+            QThread::yieldCurrentThread();
+        refill();
+    }
+    m_tokens -= bytes * NS_UNIT;
+
+    qint64 waited = m_clock.nsecsElapsed() - start;
+    m_waitNs += waited;
+    return waited;
+}
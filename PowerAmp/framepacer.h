@@ -0,0 +1,40 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <QElapsedTimer>
+
+#include "poweramp_global.h"
+#include "deadline.h"
+
+//  Token bucket for back-to-back frame transmission.
+//  Tokens are bytes; they refill at rate bytes/s up to burst bytes,
+//  so frames can be sent as fast as the amplifiers' receive buffers
+//  allow without overrunning them. A rate of 0 disables pacing.
+class POWERAMPSHARED_EXPORT FramePacer
+{
+public:
+    FramePacer();
+
+    void configure(qint64 rate, qint64 burst);
+    inline bool isEnabled() const { return m_rate > 0; }
+    inline qint64 rate() const { return m_rate; }
+    inline qint64 burst() const { return m_burst; }
+
+    //  block until bytes may be sent, returns the ns spent waiting; -1 if
+    //  the deadline or its token came first, nothing is taken then
+    qint64 acquire(qint64 bytes, const Deadline& deadline = Deadline());
+    inline qint64 totalWaitNs() const { return m_waitNs; }
+
+private:
+    qint64 m_rate;
+    qint64 m_burst;
+    //  tokens scaled by 1e9 to refill in integer arithmetic
+    qint64 m_tokens;
+    qint64 m_lastNs;
+    qint64 m_waitNs;
+    QElapsedTimer m_clock;
+
+    void refill();
+};
+
+#endif // FRAMEPACER_H
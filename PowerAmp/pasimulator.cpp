@@ -0,0 +1,96 @@
+#include "math.h"
+#include "pasimulator.h"
+
+PowerAmpSimulator::PowerAmpSimulator() :
+    m_temp(25),
+    m_fault(DEV_COUNT_MAX + 1),
+    m_turnaroundNs(0)
+{
+    reset();
+}
+
+void PowerAmpSimulator::reset()
+{
+    for (int id=0;id<=DEV_COUNT_MAX;id++)
+    {
+        m_volt[id] = 0;
+    }
+    m_frames = 0;
+    m_rejected = 0;
+}
+
+void PowerAmpSimulator::setFault(int id, bool fault)
+{
+    if (0 < id && id <= DEV_COUNT_MAX)
+    {
+        m_fault.setBit(id,fault);
+    }
+}
+
+QByteArray PowerAmpSimulator::process(const QByteArray &baSend)
+{
+    m_frames++;
+
+    //  same framing as PowerAmp::computeBaId/computeBaVolt/computeBaCheck
+    if (baSend.size() != FRAME_SIZE || !(baSend[0] & 0x80))
+    {
+        m_rejected++;
+        return QByteArray();
+    }
+    char sum = baSend[0] + baSend[1] + baSend[2] + baSend[3];
+    if ((char)(0x7F & sum) != baSend[4])
+    {
+        m_rejected++;
+        return QByteArray();
+    }
+
+    int id = (baSend[0] & 0x7F) * 128 + baSend[1];
+    int value = (baSend[2] & 0x0F) * 128 + baSend[3];
+    quint8 command = baSend[2] & 0xF0;
+
+    if (id > DEV_COUNT_MAX)
+    {
+        m_rejected++;
+        return QByteArray();
+    }
+
+    //  broadcast, everybody acts and nobody answers
+    if (id == 0)
+    {
+        for (int i=1;i<=DEV_COUNT_MAX;i++)
+        {
+            m_volt[i] = (command == 0x40) ? double(value) / double(10) : 0;
+        }
+        return QByteArray();
+    }
+
+    if (isFault(id))
+        return QByteArray();
+
+    switch (command)
+    {
+    case 0x00:
+        m_volt[id] = 0;
+        return baSend;
+    case 0x40:
+        m_volt[id] = double(value) / double(10);
+        return baSend;
+    case 0x20:
+        return echoValue(baSend,m_volt[id]);
+    case 0x10:
+        return echoValue(baSend,m_temp);
+    default:
+        m_rejected++;
+        return QByteArray();
+    }
+}
+
+QByteArray PowerAmpSimulator::echoValue(const QByteArray &baSend, double value)
+{
+    int intValue = (int)ceil(value * 10);
+    QByteArray baEcho = baSend;
+    baEcho[2] = intValue / 128;
+    baEcho[3] = intValue % 128;
+    baEcho[4] = 0x7F & (baEcho[0] + baEcho[1] + baEcho[2] + baEcho[3]);
+    return baEcho;
+}
@@ -0,0 +1,46 @@
+#ifndef PASIMULATOR_H
+#define PASIMULATOR_H
+
+#include <QByteArray>
+#include <QBitArray>
+
+#include "poweramp_global.h"
+#include "constant.h"
+#include "macro.h"
+
+//  Software model of the power amplifier bus, it answers frames the way
+//  the amplifiers do so that captures can be replayed without hardware.
+class POWERAMPSHARED_EXPORT PowerAmpSimulator
+{
+public:
+    PowerAmpSimulator();
+
+    void reset();
+
+    //  an amplifier that never answers
+    void setFault(int id, bool fault = true);
+    inline bool isFault(int id) const { return m_fault.testBit(id); }
+    inline void setTemperature(DEGREE temp) { m_temp = temp; }
+    //  processing time of an amplifier before it starts echoing
+    inline void setTurnaroundNs(qint64 turnaround) { m_turnaroundNs = turnaround; }
+    inline qint64 turnaroundNs() const { return m_turnaroundNs; }
+
+    //  returns the echo of the frame, empty if nobody answers
+    QByteArray process(const QByteArray& baSend);
+
+    inline VOLT volt(int id) const { return m_volt[id]; }
+    inline qint64 framesProcessed() const { return m_frames; }
+    inline qint64 framesRejected() const { return m_rejected; }
+
+private:
+    VOLT m_volt[DEV_COUNT_MAX + 1];
+    DEGREE m_temp;
+    QBitArray m_fault;
+    qint64 m_turnaroundNs;
+    qint64 m_frames;
+    qint64 m_rejected;
+
+    QByteArray echoValue(const QByteArray& baSend, double value);
+};
+
+#endif // PASIMULATOR_H
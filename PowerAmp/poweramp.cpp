@@ -1,6 +1,10 @@
 #include <QtSerialPort/QSerialPortInfo>
 #include <QTime>
 #include <QSettings>
+#include <QStringList>
+
+#include <algorithm>
+#include <functional>
 
 #include "math.h"
 #include "poweramp.h"
@@ -10,7 +14,13 @@
 
 Q_LOGGING_CATEGORY(PA,"POWER AMPLIFIER")
 
-PowerAmp::PowerAmp(QObject *parent) : QObject(parent)
+PowerAmp::PowerAmp(QObject *parent) : QObject(parent),
+    m_baudRate(BAUD_RATE_DEFAULT),
+    m_dataBits(QSerialPort::Data8),
+    m_parity(QSerialPort::NoParity),
+    m_stopBits(QSerialPort::OneStop),
+    m_flowControl(QSerialPort::NoFlowControl),
+    m_probeBaud(false)
 {
     initialize();
 
@@ -21,6 +31,10 @@ PowerAmp::PowerAmp(QObject *parent) : QObject(parent)
                       << m_serialPort->portName() << ".";
         connect(m_serialPort,SIGNAL(error(QSerialPort::SerialPortError)),
                 this,SLOT(handleError(QSerialPort::SerialPortError)));
+        if (!m_captureName.isEmpty())
+        {
+            startCapture(m_captureName);
+        }
     }else
     {
         qCDebug(PA()) << PA().categoryName()
@@ -54,8 +68,9 @@ void PowerAmp::initialize()
 #endif
         readSettings();
         m_serialPort = new QSerialPort(m_portName);
+        applyLineSettings();
 
-        if (resetSingle(ranId))
+        if (m_probeBaud ? probeBaudRate(ranId) : resetSingle(ranId))
         {
             qCDebug(PA()) << PA().categoryName() << "Successfully initialized.";
             return;
@@ -88,6 +103,14 @@ void PowerAmp::setPort()
     foreach (const QSerialPortInfo &serialPortInfo,serialPortInfoList)
     {
         m_serialPort = new QSerialPort(serialPortInfo);
+        applyLineSettings();
+        if (m_probeBaud && probeBaudRate(ranId))
+        {
+            m_portName = serialPortInfo.portName();
+            updateSettings();
+            qCDebug(PA()) << PA().categoryName() << "Successfully initialized.";
+            return;
+        }
         echo(baId,baVolt,baCheck);
 
         if (!m_baRead.isEmpty())
@@ -125,6 +148,7 @@ bool PowerAmp::open()
 
     if (success)
     {
+        m_profiler.setLine(m_serialPort->baudRate(),bitsPerByte());
         qCDebug(PA()) << PA().categoryName()
                       << "Opened the serial port successfully.";
     }else
@@ -183,16 +207,16 @@ void PowerAmp::echo(QByteArray baId, QByteArray baVolt, QByteArray baCheck)
     {
         if (open())
         {
-            m_serialPort->write(baId+baVolt+baCheck);
+            transmit(baId+baVolt+baCheck);
 
-            if (m_serialPort->waitForReadyRead(ECHO_PERIOD))
+            if (m_serialPort->waitForReadyRead(m_deadline.clamp(ECHO_PERIOD)))
             {
                 //  test
 //                qDebug() << "readyRead signal emitted.";
 //                qDebug() << "bytesAvailable: " << m_serialPort->bytesAvailable();
-                while(m_serialPort->bytesAvailable() != 5)
+                while(m_serialPort->bytesAvailable() != FRAME_SIZE && !m_deadline.reached())
                 {
-                    if (m_serialPort->waitForReadyRead(ECHO_PERIOD))
+                    if (m_serialPort->waitForReadyRead(m_deadline.clamp(ECHO_PERIOD)))
                     {
                         //  Do nothing, wait
                         //  test
@@ -209,18 +233,145 @@ void PowerAmp::echo(QByteArray baId, QByteArray baVolt, QByteArray baCheck)
 //                qDebug() << "cannot emit readyRead signal.";
             }
 
-            if (m_serialPort->bytesAvailable())
-            {
-                m_baRead.append(m_serialPort->readAll());
-            }
+            receive();
+        }
+    }
+}
+
+qint64 PowerAmp::transmit(const QByteArray &baSend)
+{
+    //  a cancelled sweep does not wait for tokens
+    if (m_pacer.acquire(baSend.size(),m_deadline) < 0)
+        return 0;
+    qint64 written = m_serialPort->write(baSend);
+    m_profiler.transmitted(written);
+    m_capture.record(FrameCapture::TX,baSend);
+    return written;
+}
+
+void PowerAmp::receive()
+{
+    if (m_serialPort->bytesAvailable())
+    {
+        QByteArray baReceive = m_serialPort->readAll();
+        m_profiler.received(baReceive.size());
+        m_capture.record(FrameCapture::RX,baReceive);
+        m_baRead.append(baReceive);
+    }
+}
+
+bool PowerAmp::startCapture(const QString &fileName)
+{
+    if (!exist() || !m_capture.open(fileName,m_serialPort->baudRate(),bitsPerByte()))
+    {
+        qCWarning(PA()) << PA().categoryName()
+                        << "Cannot start the frame capture to" << fileName << ".";
+        return false;
+    }
+    qCDebug(PA()) << PA().categoryName()
+                  << "Capturing the frames to" << fileName << ".";
+    return true;
+}
+
+int PowerAmp::bitsPerByte() const
+{
+    //  start bit + data bits + parity bit + stop bits
+    int bits = 1 + (int)m_serialPort->dataBits();
+    bits += (m_serialPort->parity() == QSerialPort::NoParity) ? 0 : 1;
+    bits += (m_serialPort->stopBits() == QSerialPort::OneStop) ? 1 : 2;
+    return bits;
+}
+
+void PowerAmp::applyLineSettings()
+{
+    m_serialPort->setBaudRate(m_baudRate);
+    m_serialPort->setDataBits(m_dataBits);
+    m_serialPort->setParity(m_parity);
+    m_serialPort->setStopBits(m_stopBits);
+    m_serialPort->setFlowControl(m_flowControl);
+}
+
+bool PowerAmp::probeBaudRate(int id)
+{
+    if (!exist())
+        return false;
+
+    QList<qint32> candidates = m_baudCandidates;
+    std::sort(candidates.begin(),candidates.end(),std::greater<qint32>());
+
+    foreach (qint32 baudRate, candidates)
+    {
+        //  reopen so that no byte received at the previous rate is left
+        close();
+        m_serialPort->setBaudRate(baudRate);
+
+        bool valid = false;
+        for (int i=0;i<PROBE_ATTEMPTS && !valid;i++)
+        {
+            valid = resetSingle(id);
         }
+
+        if (valid)
+        {
+            m_baudRate = baudRate;
+            m_profiler.setLine(m_baudRate,bitsPerByte());
+            updateSettings();
+            qCDebug(PA()) << PA().categoryName()
+                          << "Baud rate" << baudRate << "validated.";
+            return true;
+        }
+        qCDebug(PA()) << PA().categoryName()
+                      << "No echo at" << baudRate << "baud.";
     }
+
+    close();
+    m_serialPort->setBaudRate(m_baudRate);
+    qCWarning(PA()) << PA().categoryName()
+                    << "No candidate baud rate validated.";
+    return false;
 }
 
 void PowerAmp::readSettings()
 {
     QSettings* settings = new QSettings(SETTINGS_PATH,QSettings::IniFormat);
     m_portName = settings->value("PowerAmp/port").toString();
+
+    m_baudRate = settings->value("PowerAmp/baudRate",BAUD_RATE_DEFAULT).toInt();
+    if (m_baudRate <= 0)
+        m_baudRate = BAUD_RATE_DEFAULT;
+    //  QSerialPort::DataBits holds 5 to 8, anything else takes the default
+    int dataBits = settings->value("PowerAmp/dataBits",8).toInt();
+    m_dataBits = (QSerialPort::Data5 <= dataBits && dataBits <= QSerialPort::Data8) ?
+                 (QSerialPort::DataBits)dataBits : QSerialPort::Data8;
+    QString parity = settings->value("PowerAmp/parity","none").toString().toLower();
+    m_parity = (parity == "even") ? QSerialPort::EvenParity :
+               (parity == "odd") ? QSerialPort::OddParity :
+               (parity == "space") ? QSerialPort::SpaceParity :
+               (parity == "mark") ? QSerialPort::MarkParity : QSerialPort::NoParity;
+    QString stopBits = settings->value("PowerAmp/stopBits","1").toString();
+    m_stopBits = (stopBits == "2") ? QSerialPort::TwoStop :
+                 (stopBits == "1.5") ? QSerialPort::OneAndHalfStop : QSerialPort::OneStop;
+    QString flowControl = settings->value("PowerAmp/flowControl","none").toString().toLower();
+    m_flowControl = (flowControl == "hardware") ? QSerialPort::HardwareControl :
+                    (flowControl == "software") ? QSerialPort::SoftwareControl :
+                                                  QSerialPort::NoFlowControl;
+
+    m_probeBaud = settings->value("PowerAmp/probeBaud",false).toBool();
+    m_baudCandidates.clear();
+    foreach (const QString& candidate,
+             settings->value("PowerAmp/baudCandidates",
+                             QString(BAUD_CANDIDATES_DEFAULT).split(',')).toStringList())
+    {
+        bool ok = false;
+        qint32 baudRate = candidate.trimmed().toInt(&ok);
+        if (ok && baudRate > 0)
+            m_baudCandidates.append(baudRate);
+    }
+    m_profiler.setEnabled(settings->value("PowerAmp/profile",false).toBool());
+    m_captureName = settings->value("PowerAmp/capture").toString();
+    //  bytes per second and bucket size in bytes, a rate of 0 disables pacing
+    m_pacer.configure(settings->value("PowerAmp/pacerRate",PACER_RATE_DEFAULT).toLongLong(),
+                      settings->value("PowerAmp/pacerBurst",PACER_BURST_DEFAULT).toLongLong());
     delete settings;
 }
 
@@ -228,6 +379,7 @@ void PowerAmp::updateSettings()
 {
     QSettings* settings = new QSettings(SETTINGS_PATH,QSettings::IniFormat);
     settings->setValue("PowerAmp/port",m_portName);
+    settings->setValue("PowerAmp/baudRate",m_baudRate);
     delete settings;
 }
 
@@ -396,68 +548,97 @@ bool PowerAmp::startSingle(int id, VOLT volt)
     return success;
 }
 
-bool PowerAmp::startAll(VOLT volt)
+bool PowerAmp::startAll(VOLT volt, int timeout, const CancelToken *token)
 {
-    bool success = false;
-    QList<int> errorId;
+    return startAllResult(volt,timeout,token).success();
+}
 
+const SweepResult& PowerAmp::startAllResult(VOLT volt, int timeout, const CancelToken *token)
+{
+    beginSweep(timeout,token);
     double time_Start = (double)clock();
+    QElapsedTimer idTimer;
     for (int id=1;id<=DEV_COUNT_MAX;id++)
     {
+        if (m_deadline.reached())
+        {
+            m_result.aborted = true;
+            break;
+        }
+
+        idTimer.start();
         int safeCounter = 0;
         while (true)
         {
             if (startSingle(id,volt))
+            {
+                m_result.ok.set(id);
                 break;
+            }
             else
                 safeCounter++;
 
-            if (safeCounter == SAFE_COUNTER)
+            if (safeCounter == SAFE_COUNTER || m_deadline.reached())
             {
-                errorId.append(id);
+                m_result.failed.set(id);
+                //  out of time, not out of retries; the last id too
+                if (m_deadline.reached())
+                    m_result.aborted = true;
                 break;
             }
         }
+        m_result.retries[id] = safeCounter;
+        m_result.latencyUs[id] = idTimer.nsecsElapsed() / 1000;
     }
     double time_End = (double)clock();
     qCWarning(PA()) << PA().categoryName()
                     << "startAll Time: "<< (time_End - time_Start) / 1000.0 << "s";
 
-    if (!errorId.isEmpty())
+    //  the amplifier may have started although its echo was lost
+    for (int id=1;id<=DEV_COUNT_MAX && m_result.failed.any();id++)
     {
-        for(int i=0;i<errorId.size();i++)
+        if (m_deadline.reached())
+            break;
+        if (m_result.failed.test(id) && echoVolt(id) != -1)
         {
-            if (echoVolt(errorId.at(i)) == -1)
-            {
-                m_errorId.append(errorId.at(i));
-            }
+            m_result.failed.reset(id);
+            m_result.ok.set(id);
         }
     }
 
-    if (m_errorId.isEmpty())
+    if (m_result.aborted)
+    {
+        qCWarning(PA()) << PA().categoryName()
+                        << "startAll aborted after" << m_result.doneCount()
+                        << "of" << DEV_COUNT_MAX << "power amplifiers.";
+    }
+
+    if (m_result.success())
     {
         qCDebug(PA()) << PA().categoryName()
                       << "Started all the power amplifiers successfully.";
-        success = true;
         emit actionCompleted();
-    }else
+    }else if (m_result.failed.any())
     {
         qCWarning(PA()) << PA().categoryName()
                         << "Failed to start all the power amplifiers.";
         qCWarning(PA()) << PA().categoryName()
-                        << m_errorId.size() << "power amplifiers have error.";
+                        << m_result.failedCount() << "power amplifiers have error.";
         qCWarning(PA()) << PA().categoryName()
-                        << "They are: " << "#" << m_errorId;
-        m_errorId.clear();
+                        << "They are: " << "#" << m_result.failedIds();
     }
+    endSweep();
 
-    return success;
+    return m_result;
 }
 
-bool PowerAmp::startAll2(VOLT volt)
+bool PowerAmp::startAll2(VOLT volt, int timeout, const CancelToken *token)
 {
-    bool success = false;
+    return startAll2Result(volt,timeout,token).success();
+}
 
+const SweepResult& PowerAmp::startAll2Result(VOLT volt, int timeout, const CancelToken *token)
+{
     QByteArray baId;
     baId[0] = 0x80;
     baId[1] = 0x00;
@@ -465,44 +646,43 @@ bool PowerAmp::startAll2(VOLT volt)
     QByteArray baVolt = computeBaVolt(START,volt);
     QByteArray baCheck = computeBaCheck(baId,baVolt);
 
+    beginSweep(timeout,token);
     double time_Start = (double)clock();
     if (open())
     {
-        m_serialPort->write(baId+baVolt+baCheck);
-        m_serialPort->waitForReadyRead(ECHO_PERIOD);
+        transmit(baId+baVolt+baCheck);
+        m_serialPort->waitForReadyRead(m_deadline.clamp(ECHO_PERIOD));
     }
 
-//    VOLT tmpVolt;
-    for (int i=1;i<=DEV_COUNT_MAX;i++)
-    {
-//        tmpVolt = echoVolt(i);
-        if (echoVolt(i) == -1)
-        {
-            m_errorId.append(i);
-        }
-    }
+    verifyAll();
     double time_End = (double)clock();
     qCWarning(PA()) << PA().categoryName()
                     << "startAll2 Time: "<< (time_End - time_Start) / 1000.0 << "s";
 
-    if (m_errorId.isEmpty())
+    if (m_result.aborted)
+    {
+        qCWarning(PA()) << PA().categoryName()
+                        << "startAll2 aborted after" << m_result.doneCount()
+                        << "of" << DEV_COUNT_MAX << "power amplifiers.";
+    }
+
+    if (m_result.success())
     {
         qCDebug(PA()) << PA().categoryName()
                       << "Started all the power amplifiers successfully.";
-        success = true;
         emit actionCompleted();
-    }else
+    }else if (m_result.failed.any())
     {
         qCWarning(PA()) << PA().categoryName()
                         << "Failed to start all the power amplifiers.";
         qCWarning(PA()) << PA().categoryName()
-                        << m_errorId.size() << "power amplifiers have error.";
+                        << m_result.failedCount() << "power amplifiers have error.";
         qCWarning(PA()) << PA().categoryName()
-                        << "They are: " << "#" << m_errorId;
-        m_errorId.clear();
+                        << "They are: " << "#" << m_result.failedIds();
     }
+    endSweep();
 
-    return success;
+    return m_result;
 }
 
 bool PowerAmp::resetSingle(int id)
@@ -536,39 +716,62 @@ bool PowerAmp::resetSingle(int id)
     return success;
 }
 
-bool PowerAmp::resetAll()
+bool PowerAmp::resetAll(int timeout, const CancelToken *token)
 {
-    bool success = false;
-
-    QList<int> errorId;
+    return resetAllResult(timeout,token).success();
+}
 
+const SweepResult& PowerAmp::resetAllResult(int timeout, const CancelToken *token)
+{
+    beginSweep(timeout,token);
     double time_Start = (double)clock();
+    QElapsedTimer idTimer;
     for (int id=1;id<=DEV_COUNT_MAX;id++)
     {
+        if (m_deadline.reached())
+        {
+            m_result.aborted = true;
+            break;
+        }
+
+        idTimer.start();
         int safeCounter = 0;
         while(true)
         {
             if (resetSingle(id))
+            {
+                m_result.ok.set(id);
                 break;
+            }
             else
                 safeCounter++;
 
-            if (safeCounter == SAFE_COUNTER)
+            if (safeCounter == SAFE_COUNTER || m_deadline.reached())
             {
-                errorId.append(id);
+                m_result.failed.set(id);
+                //  out of time, not out of retries; the last id too
+                if (m_deadline.reached())
+                    m_result.aborted = true;
                 break;
             }
         }
+        m_result.retries[id] = safeCounter;
+        m_result.latencyUs[id] = idTimer.nsecsElapsed() / 1000;
     }
 
-    if (!errorId.isEmpty())
+    for (int id=1;id<=DEV_COUNT_MAX && m_result.failed.any();id++)
     {
-        for(int i=0;i<errorId.size();i++)
-        {            
-            if (echoVolt(errorId.at(i)) == -1)
+        if (m_deadline.reached())
+            break;
+        if (m_result.failed.test(id))
+        {
+            if (echoVolt(id) == -1)
+            {
+                qDebug() << "#" << id << "Failed to reset.";
+            }else
             {
-                qDebug() << "#" << errorId.at(i) << "Failed to reset.";
-                m_errorId.append(errorId.at(i));
+                m_result.failed.reset(id);
+                m_result.ok.set(id);
             }
         }
     }
@@ -576,31 +779,40 @@ bool PowerAmp::resetAll()
     qCWarning(PA()) << PA().categoryName()
                     << "resetAll Time: "<< (time_End - time_Start) / 1000.0 << "s";
 
-    if (m_errorId.isEmpty())
+    if (m_result.aborted)
+    {
+        qCWarning(PA()) << PA().categoryName()
+                        << "resetAll aborted after" << m_result.doneCount()
+                        << "of" << DEV_COUNT_MAX << "power amplifiers.";
+    }
+
+    if (m_result.success())
     {
-        success = true;
         qCDebug(PA()) << PA().categoryName()
                       << "Reset all the power amplifiers successfully.";
         emit actionCompleted();
 
-    }else
+    }else if (m_result.failed.any())
     {
         qCWarning(PA()) << PA().categoryName()
                         << "Failed to reset all the power amplifiers.";
         qCWarning(PA()) << PA().categoryName()
-                        << m_errorId.size() << "power amplifiers have error.";
+                        << m_result.failedCount() << "power amplifiers have error.";
         qCWarning(PA()) << PA().categoryName()
-                        << "They are:" << "#" << m_errorId;
-        m_errorId.clear();
+                        << "They are:" << "#" << m_result.failedIds();
     }
+    endSweep();
 
-    return success;
+    return m_result;
 }
 
-bool PowerAmp::resetAll2()
+bool PowerAmp::resetAll2(int timeout, const CancelToken *token)
 {
-    bool success = false;
+    return resetAll2Result(timeout,token).success();
+}
 
+const SweepResult& PowerAmp::resetAll2Result(int timeout, const CancelToken *token)
+{
     QByteArray baSend;
     baSend[0] = 0x80;
     baSend[1] = 0x00;
@@ -608,45 +820,93 @@ bool PowerAmp::resetAll2()
     baSend[3] = 0x00;
     baSend[4] = 0x00;
 
+    beginSweep(timeout,token);
     double time_Start = (double)clock();
     if (open())
     {
-        m_serialPort->write(baSend);
-        m_serialPort->waitForReadyRead(ECHO_PERIOD);
+        transmit(baSend);
+        m_serialPort->waitForReadyRead(m_deadline.clamp(ECHO_PERIOD));
     }
 
-//    VOLT tmpVolt;
-    for (int i=1;i<=DEV_COUNT_MAX;i++)
-    {
-//        tmpVolt = echoVolt(i);
-        if (echoVolt(i) == -1)
-        {
-            m_errorId.append(i);
-        }
-    }
+    verifyAll();
     double time_End = (double)clock();
     qCWarning(PA()) << PA().categoryName()
                     << "resetAll2 Time: "<< (time_End - time_Start) / 1000.0 << "s";
 
-    if (m_errorId.isEmpty())
+    if (m_result.aborted)
+    {
+        qCWarning(PA()) << PA().categoryName()
+                        << "resetAll2 aborted after" << m_result.doneCount()
+                        << "of" << DEV_COUNT_MAX << "power amplifiers.";
+    }
+
+    if (m_result.success())
     {
-        success = true;
         qCDebug(PA()) << PA().categoryName()
                       << "Reset all the power amplifiers successfully.";
         emit actionCompleted();
 
-    }else
+    }else if (m_result.failed.any())
     {
         qCWarning(PA()) << PA().categoryName()
                         << "Failed to reset all the power amplifiers.";
         qCWarning(PA()) << PA().categoryName()
-                        << m_errorId.size() << "power amplifiers have error.";
+                        << m_result.failedCount() << "power amplifiers have error.";
         qCWarning(PA()) << PA().categoryName()
-                        << "They are:" << "#" << m_errorId;
-        m_errorId.clear();
+                        << "They are:" << "#" << m_result.failedIds();
     }
+    endSweep();
 
-    return success;
+    return m_result;
+}
+
+void PowerAmp::verifyAll()
+{
+    QElapsedTimer idTimer;
+    for (int id=1;id<=DEV_COUNT_MAX;id++)
+    {
+        if (m_deadline.reached())
+        {
+            m_result.aborted = true;
+            break;
+        }
+
+        idTimer.start();
+        if (echoVolt(id) == -1)
+        {
+            m_result.failed.set(id);
+            if (m_deadline.reached())
+                m_result.aborted = true;
+        }
+        else
+            m_result.ok.set(id);
+        m_result.latencyUs[id] = idTimer.nsecsElapsed() / 1000;
+    }
+}
+
+void PowerAmp::beginSweep(int timeout, const CancelToken *token)
+{
+    m_deadline = Deadline(timeout,token);
+    m_result.clear();
+    //  endSweep() logs the traffic of this sweep alone
+    m_profiler.reset();
+    m_sweepTimer.start();
+}
+
+void PowerAmp::endSweep()
+{
+    m_result.totalUs = m_sweepTimer.nsecsElapsed() / 1000;
+    //  single operations outside a sweep are not bounded
+    m_deadline = Deadline();
+    if (m_profiler.isEnabled())
+    {
+        qCDebug(PA()) << PA().categoryName()
+                      << "Bus:" << m_profiler.summary();
+    }
+    if (m_result.aborted)
+    {
+        emit actionAborted();
+    }
 }
 
 VOLT PowerAmp::echoVolt(int id)
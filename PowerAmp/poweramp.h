@@ -9,6 +9,11 @@
 #include "poweramp_global.h"
 #include "constant.h"
 #include "macro.h"
+#include "deadline.h"
+#include "busprofiler.h"
+#include "framepacer.h"
+#include "framecapture.h"
+#include "sweepresult.h"
 
 Q_DECLARE_LOGGING_CATEGORY(PA)
 
@@ -31,25 +36,52 @@ public:
     //  used in the constructor or other places
     void initialize();
     inline bool exist() {return m_serialPort != NULL ? true : false;}
+    //  try the candidate baud rates fastest-first with a reset echo of #id
+    //  and keep (and persist) the fastest one that validates
+    bool probeBaudRate(int id = 1);
 
     bool resetSingle(int id);
     //  send only 5 bytes to reset all the power amplifiers
-    bool resetAll2();
+    bool resetAll2(int timeout = DEADLINE_NONE, const CancelToken* token = 0);
+    const SweepResult& resetAll2Result(int timeout = DEADLINE_NONE, const CancelToken* token = 0);
     bool startSingle(int id, VOLT volt);
     //  send only 5 bytes to start all the power amplifiers at the set voltage
-    bool startAll2(VOLT volt);
+    bool startAll2(VOLT volt, int timeout = DEADLINE_NONE, const CancelToken* token = 0);
+    const SweepResult& startAll2Result(VOLT volt, int timeout = DEADLINE_NONE,
+                                       const CancelToken* token = 0);
     //  get the current voltage of the set power amplifier
     VOLT echoVolt(int id);
     //  get the current temperature of the set power amplifier
     DEGREE echoTemp(int id);
 
+    //  the slots below with their per-id outcome, which is lastResult()
+    const SweepResult& resetAllResult(int timeout = DEADLINE_NONE, const CancelToken* token = 0);
+    const SweepResult& startAllResult(VOLT volt, int timeout = DEADLINE_NONE,
+                                      const CancelToken* token = 0);
+    //  per-id outcome of the last bulk operation, also when it was aborted
+    //  by its deadline or cancellation token; reused by every sweep
+    inline const SweepResult& lastResult() const { return m_result; }
+
+    //  traffic accounting of the serial bus, enabled by PowerAmp/profile;
+    //  every sweep starts it over
+    inline const BusProfiler& busProfiler() const { return m_profiler; }
+    inline void resetBusProfiler() { m_profiler.reset(); }
+
+    //  record every frame on the bus into a binary capture file,
+    //  started at construction if PowerAmp/capture names a file
+    bool startCapture(const QString& fileName);
+    inline void stopCapture() { m_capture.close(); }
+
 public slots:
-    bool resetAll();
-    bool startAll(VOLT volt);    
+    //  timeout in ms for the whole sweep, DEADLINE_NONE for unbounded;
+    //  true if every power amplifier answered
+    bool resetAll(int timeout = DEADLINE_NONE, const CancelToken* token = 0);
+    bool startAll(VOLT volt, int timeout = DEADLINE_NONE, const CancelToken* token = 0);
 
 signals:
     void error(QString errorString);
     void actionCompleted();
+    void actionAborted();
 
 private:
     //  set the serial port for the communication of power amplifiers
@@ -57,11 +89,37 @@ private:
     QSerialPort* m_serialPort;
     QString m_portName;
 
+    //  line settings of the bus, read from PowerAmp/* in config.ini
+    qint32 m_baudRate;
+    QSerialPort::DataBits m_dataBits;
+    QSerialPort::Parity m_parity;
+    QSerialPort::StopBits m_stopBits;
+    QSerialPort::FlowControl m_flowControl;
+    bool m_probeBaud;
+    QList<qint32> m_baudCandidates;
+    void applyLineSettings();
+
     //  the procedure of sending the set bytes and reading the echoed bytes
     void echo(QByteArray baId,QByteArray baVolt,QByteArray baCheck);
     QByteArray m_baRead;
 
-    QList<int> m_errorId;
+    //  every frame goes through the pacer and the profiler
+    qint64 transmit(const QByteArray& baSend);
+    void receive();
+    BusProfiler m_profiler;
+    FramePacer m_pacer;
+    FrameCapture m_capture;
+    QString m_captureName;
+    int bitsPerByte() const;
+
+    SweepResult m_result;
+    QElapsedTimer m_sweepTimer;
+    //  deadline of the running bulk operation, bounds every echo wait
+    Deadline m_deadline;
+    void beginSweep(int timeout, const CancelToken* token);
+    void endSweep();
+    //  echo the voltage of every id after a broadcast
+    void verifyAll();
 
     bool open();
     void close();
@@ -0,0 +1,54 @@
+#ifndef SWEEPRESULT_H
+#define SWEEPRESULT_H
+
+#include <QList>
+#include <bitset>
+#include <string.h>
+
+#include "constant.h"
+
+//  Outcome of a bulk power amplifier operation, indexed by id 1 ~ DEV_COUNT_MAX.
+//  PowerAmp owns one instance and refills it on every sweep, so reading it
+//  neither allocates nor parses the log.
+class SweepResult
+{
+public:
+    SweepResult() { clear(); }
+
+    inline void clear()
+    {
+        ok.reset();
+        failed.reset();
+        memset(retries,0,sizeof(retries));
+        memset(latencyUs,0,sizeof(latencyUs));
+        aborted = false;
+        totalUs = 0;
+    }
+
+    //  an id is in neither set if the sweep was aborted before reaching it
+    std::bitset<DEV_COUNT_MAX + 1> ok;
+    std::bitset<DEV_COUNT_MAX + 1> failed;
+    quint8 retries[DEV_COUNT_MAX + 1];
+    quint32 latencyUs[DEV_COUNT_MAX + 1];
+    bool aborted;
+    qint64 totalUs;
+
+    inline bool success() const { return !aborted && failed.none(); }
+    inline bool done(int id) const { return ok.test(id) || failed.test(id); }
+    inline int doneCount() const { return (int)(ok | failed).count(); }
+    inline int failedCount() const { return (int)failed.count(); }
+
+    //  for logging only
+    QList<int> failedIds() const
+    {
+        QList<int> ids;
+        for (int id=1;id<=DEV_COUNT_MAX;id++)
+        {
+            if (failed.test(id))
+                ids.append(id);
+        }
+        return ids;
+    }
+};
+
+#endif // SWEEPRESULT_H
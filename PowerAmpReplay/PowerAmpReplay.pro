@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# Replay of PowerAmp frame captures on the amplifier simulator
+#
+#-------------------------------------------------
+
+QT       -= gui
+
+TARGET = PowerAmpReplay
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+#   the capture reader and the simulator are built in, no serial port needed
+DEFINES += POWERAMP_LIBRARY
+
+INCLUDEPATH += ../lib/common \
+    ../PowerAmp
+
+SOURCES += main.cpp \
+    ../PowerAmp/framecapture.cpp \
+    ../PowerAmp/pasimulator.cpp
+
+HEADERS += ../PowerAmp/framecapture.h \
+    ../PowerAmp/pasimulator.h
@@ -0,0 +1,183 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QVector>
+
+#include "framecapture.h"
+#include "pasimulator.h"
+
+//  one request of the capture with the bytes echoed before the next one
+typedef struct ReplayFrame
+{
+    QByteArray baSend;
+    QByteArray baReceive;
+    quint64 txNs;
+    quint64 rxNs;
+}_ReplayFrame;
+
+static qint64 wireNs(int bytes, const CaptureHeader* header)
+{
+    return qint64(bytes) * header->bitsPerByte * Q_INT64_C(1000000000) / header->baudRate;
+}
+
+//  0, which no amplifier has, for a frame too short to hold an id
+static int frameId(const QByteArray& baSend)
+{
+    if (baSend.size() < 2)
+        return 0;
+    return (baSend[0] & 0x7F) * 128 + baSend[1];
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    QStringList args = a.arguments();
+    bool realtime = args.removeAll("--realtime") > 0;
+    if (args.size() != 2)
+    {
+        out << "usage: PowerAmpReplay [--realtime] capture.bin" << endl;
+        return 1;
+    }
+
+    FrameCaptureReader reader;
+    if (!reader.open(args.at(1)))
+    {
+        out << "Cannot read the capture " << args.at(1) << endl;
+        return 1;
+    }
+    const CaptureHeader* header = reader.header();
+
+    //  rebuild the request/echo pairs, split records are joined again
+    QVector<ReplayFrame> frames;
+    bool skipping = false;
+    for (qint64 i=0;i<reader.count();i++)
+    {
+        const FrameRecord& record = reader.records()[i];
+        QByteArray data((const char*)record.data,record.length);
+        if (record.direction == FrameCapture::TX)
+        {
+            //  too short to hold an id, its echo goes with it
+            skipping = (record.length < 2);
+            if (skipping)
+                continue;
+            ReplayFrame frame;
+            frame.baSend = data;
+            frame.txNs = record.timestampNs;
+            frame.rxNs = 0;
+            frames.append(frame);
+        }else if (!frames.isEmpty() && !skipping)
+        {
+            frames.last().baReceive.append(data);
+            frames.last().rxNs = record.timestampNs;
+        }
+    }
+    if (frames.isEmpty())
+    {
+        out << "The capture holds no frame." << endl;
+        return 0;
+    }
+
+    //  ids that never answered are modelled as faulty amplifiers,
+    //  the mean turnaround of the others as the amplifier latency
+    PowerAmpSimulator simulator;
+    QVector<bool> answered(DEV_COUNT_MAX + 1,false);
+    QVector<bool> addressed(DEV_COUNT_MAX + 1,false);
+    qint64 turnaroundTotal = 0;
+    qint64 echoes = 0;
+    foreach (const ReplayFrame& frame, frames)
+    {
+        if (frame.baSend.size() != FRAME_SIZE)
+            continue;
+        int id = frameId(frame.baSend);
+        if (id <= 0 || id > DEV_COUNT_MAX)
+            continue;
+        addressed[id] = true;
+        if (!frame.baReceive.isEmpty())
+        {
+            answered[id] = true;
+            turnaroundTotal += frame.rxNs - frame.txNs - wireNs(frame.baSend.size() * 2,header);
+            echoes++;
+        }
+    }
+    QList<int> faults;
+    for (int id=1;id<=DEV_COUNT_MAX;id++)
+    {
+        if (addressed[id] && !answered[id])
+        {
+            simulator.setFault(id);
+            faults.append(id);
+        }
+    }
+    simulator.setTurnaroundNs(echoes ? qMax(Q_INT64_C(0),turnaroundTotal / echoes) : 0);
+
+    //  replay, optionally at the recorded pace
+    qint64 simulatedNs = 0;
+    qint64 mismatches = 0;
+    qint64 timeouts = 0;
+    qint64 latencyMin = -1;
+    qint64 latencyMax = 0;
+    qint64 latencyTotal = 0;
+    //  frames with a recorded echo, not the same set as echoes above
+    qint64 latencies = 0;
+    QElapsedTimer clock;
+    clock.start();
+    foreach (const ReplayFrame& frame, frames)
+    {
+        if (realtime)
+        {
+            qint64 ahead = qint64(frame.txNs - frames.first().txNs) - clock.nsecsElapsed();
+            if (ahead > 0)
+                QThread::usleep(ahead / 1000);
+        }
+
+        QByteArray baEcho = simulator.process(frame.baSend);
+        if (baEcho != frame.baReceive)
+            mismatches++;
+
+        if (baEcho.isEmpty())
+        {
+            simulatedNs += wireNs(frame.baSend.size(),header) + qint64(ECHO_PERIOD) * 1000000;
+            timeouts++;
+        }else
+        {
+            simulatedNs += wireNs(frame.baSend.size() + baEcho.size(),header) +
+                           simulator.turnaroundNs();
+        }
+
+        if (!frame.baReceive.isEmpty())
+        {
+            qint64 latency = frame.rxNs - frame.txNs;
+            latencyMin = (latencyMin < 0 || latency < latencyMin) ? latency : latencyMin;
+            latencyMax = qMax(latencyMax,latency);
+            latencyTotal += latency;
+            latencies++;
+        }
+    }
+
+    qint64 recordedNs = frames.last().txNs - frames.first().txNs;
+    out << "capture:       " << args.at(1) << endl
+        << "baud rate:     " << header->baudRate << endl
+        << "frames:        " << frames.size() << endl
+        << "echoes:        " << echoes << endl
+        << "recorded:      " << recordedNs / 1000 << " us" << endl
+        << "simulated:     " << simulatedNs / 1000 << " us" << endl
+        << "replayed in:   " << clock.nsecsElapsed() / 1000 << " us" << endl
+        << "turnaround:    " << simulator.turnaroundNs() / 1000 << " us" << endl
+        << "echo latency:  min " << qMax(latencyMin,Q_INT64_C(0)) / 1000
+        << " us, mean " << (latencies ? latencyTotal / latencies : 0) / 1000
+        << " us, max " << latencyMax / 1000 << " us" << endl
+        << "timeouts:      " << timeouts << endl
+        << "mismatches:    " << mismatches << endl
+        << "faulty ids:    " << faults.size();
+    foreach (int id, faults)
+    {
+        out << " #" << id;
+    }
+    out << endl;
+
+    return 0;
+}
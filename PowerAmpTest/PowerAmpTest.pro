@@ -0,0 +1,32 @@
+#-------------------------------------------------
+#
+# Unit tests of the PowerAmp sweeps, no amplifier needed
+#
+#-------------------------------------------------
+
+QT       -= gui
+QT       += serialport testlib
+
+TARGET = tst_poweramp
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+DEFINES += POWERAMP_LIBRARY
+
+INCLUDEPATH += ../lib/common \
+    ../PowerAmp
+
+SOURCES += tst_poweramp.cpp \
+    ../PowerAmp/poweramp.cpp \
+    ../PowerAmp/busprofiler.cpp \
+    ../PowerAmp/framepacer.cpp \
+    ../PowerAmp/framecapture.cpp
+
+HEADERS += ../PowerAmp/poweramp.h \
+    ../PowerAmp/poweramp_global.h \
+    ../PowerAmp/busprofiler.h \
+    ../PowerAmp/framepacer.h \
+    ../PowerAmp/framecapture.h \
+    ../PowerAmp/sweepresult.h
@@ -0,0 +1,160 @@
+#include <QtTest>
+
+#include "poweramp.h"
+#include "sweepresult.h"
+#include "deadline.h"
+
+//  The sweeps run on whatever the constructor finds: without an amplifier
+//  every echo fails at once, with one the unbounded sweep is skipped and
+//  the aborted ones never reach the bus.
+class TestPowerAmp : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void resultSets();
+    void deadlineReached();
+    void canceledSweepIsAborted();
+    void expiredSweepIsAborted();
+    void broadcastSweepIsAborted();
+    void failedWithoutAmplifier();
+
+private:
+    PowerAmp *m_amp;
+};
+
+void TestPowerAmp::initTestCase()
+{
+    m_amp = new PowerAmp();
+}
+
+void TestPowerAmp::cleanupTestCase()
+{
+    delete m_amp;
+    m_amp = 0;
+}
+
+void TestPowerAmp::resultSets()
+{
+    SweepResult result;
+    QVERIFY(result.success());
+    QCOMPARE(result.doneCount(),0);
+
+    result.ok.set(1);
+    result.failed.set(2);
+    QVERIFY(result.done(1));
+    QVERIFY(result.done(2));
+    QVERIFY(!result.done(3));
+    QCOMPARE(result.doneCount(),2);
+    QCOMPARE(result.failedCount(),1);
+    QCOMPARE(result.failedIds(),QList<int>() << 2);
+    QVERIFY(!result.success());
+
+    //  aborted fails the sweep even if every id reached so far answered
+    result.failed.reset(2);
+    QVERIFY(result.success());
+    result.aborted = true;
+    QVERIFY(!result.success());
+
+    result.clear();
+    QVERIFY(result.success());
+    QCOMPARE(result.doneCount(),0);
+}
+
+void TestPowerAmp::deadlineReached()
+{
+    QVERIFY(!Deadline().reached());
+    QCOMPARE(Deadline().remaining(),DEADLINE_NONE);
+    QCOMPARE(Deadline().clamp(ECHO_PERIOD),ECHO_PERIOD);
+
+    Deadline expired(0);
+    QVERIFY(expired.reached());
+    QCOMPARE(expired.remaining(),0);
+    QCOMPARE(expired.clamp(ECHO_PERIOD),0);
+
+    CancelToken token;
+    Deadline canceled(DEADLINE_NONE,&token);
+    QVERIFY(!canceled.reached());
+    token.cancel();
+    QVERIFY(canceled.reached());
+    QVERIFY(!canceled.expired());
+    token.reset();
+    QVERIFY(!canceled.reached());
+}
+
+void TestPowerAmp::canceledSweepIsAborted()
+{
+    CancelToken token;
+    token.cancel();
+
+    const SweepResult& start = m_amp->startAllResult(1,DEADLINE_NONE,&token);
+    QVERIFY(start.aborted);
+    QVERIFY(!start.success());
+    //  no id was reached, none is marked either way
+    QCOMPARE(start.doneCount(),0);
+    QCOMPARE(&m_amp->lastResult(),&start);
+
+    const SweepResult& reset = m_amp->resetAllResult(DEADLINE_NONE,&token);
+    QVERIFY(reset.aborted);
+    QCOMPARE(reset.doneCount(),0);
+
+    QVERIFY(!m_amp->startAll(1,DEADLINE_NONE,&token));
+    QVERIFY(!m_amp->resetAll(DEADLINE_NONE,&token));
+}
+
+void TestPowerAmp::expiredSweepIsAborted()
+{
+    const SweepResult& start = m_amp->startAllResult(1,0);
+    QVERIFY(start.aborted);
+    QVERIFY(!start.success());
+    QCOMPARE(start.doneCount(),0);
+
+    const SweepResult& reset = m_amp->resetAllResult(0);
+    QVERIFY(reset.aborted);
+    QCOMPARE(reset.doneCount(),0);
+}
+
+void TestPowerAmp::broadcastSweepIsAborted()
+{
+    //  the broadcast may go out, the verification of every id does not
+    const SweepResult& start = m_amp->startAll2Result(1,0);
+    QVERIFY(start.aborted);
+    QCOMPARE(start.doneCount(),0);
+
+    const SweepResult& reset = m_amp->resetAll2Result(0);
+    QVERIFY(reset.aborted);
+    QCOMPARE(reset.doneCount(),0);
+}
+
+void TestPowerAmp::failedWithoutAmplifier()
+{
+    if (m_amp->exist())
+        QSKIP("An amplifier answered, the sweep would drive it.");
+
+    //  out of retries, not out of time: every id failed, none aborted
+    const SweepResult& result = m_amp->startAllResult(1);
+    QVERIFY(!result.aborted);
+    QVERIFY(!result.success());
+    QCOMPARE(result.failedCount(),DEV_COUNT_MAX);
+    QCOMPARE(result.doneCount(),DEV_COUNT_MAX);
+    QVERIFY(result.ok.none());
+    QVERIFY(!result.failed.test(0));
+    QCOMPARE(result.retries[1],(quint8)SAFE_COUNTER);
+    QCOMPARE(result.retries[DEV_COUNT_MAX],(quint8)SAFE_COUNTER);
+
+    const SweepResult& broadcast = m_amp->resetAll2Result();
+    QVERIFY(!broadcast.aborted);
+    QCOMPARE(broadcast.failedCount(),DEV_COUNT_MAX);
+
+    //  the result is reused, the next sweep starts from nothing
+    const SweepResult& aborted = m_amp->startAllResult(1,0);
+    QVERIFY(aborted.aborted);
+    QCOMPARE(aborted.doneCount(),0);
+}
+
+QTEST_GUILESS_MAIN(TestPowerAmp)
+
+#include "tst_poweramp.moc"
@@ -5,7 +5,9 @@
 #define VOLTAGE 14
 #define MS_UNIT 1000
 #define PERCENT_UNIT 100
+#define MM_UNIT 1000
 #define TEST_SPOT_COUNT 20
+#define DEADLINE_NONE -1
 //  FINISH
 
 //  DOCONTROLLER PARAMETERS
@@ -31,7 +33,15 @@
 #define BYTE_LOCK 0x00
 #define BYTE_ENABLE 0x40
 #define BYTE_DISABLE 0x00
+#define MASK_LOAD 0x80
+#define MASK_ENABLE 0x40
+#define DO_PORT_COUNT 6
 #define TRANSDUCER_COUNT 144
+#define DO_SAMPLE_PORTS 3
+#define DO_SAMPLE_RATE 100000
+#define DO_STREAM_MARGIN 100
+#define DO_ERROR_RETRIES 2
+#define DO_BOARD_MAX 8
 //  FINISH
 
 //  PA PARAMETERS
@@ -41,6 +51,29 @@
 #define VOLT_MAX 18
 #define TEST_CHANNEL 15
 #define ECHO_PERIOD 50
+#define FRAME_SIZE 5
+#define BAUD_RATE_DEFAULT 9600
+#define BAUD_CANDIDATES_DEFAULT "115200,57600,38400,19200,9600"
+#define PROBE_ATTEMPTS 2
+#define PACER_RATE_DEFAULT 0
+#define PACER_BURST_DEFAULT 64
+//  FINISH
+
+//  PHASE ENGINE PARAMETERS
+//  Hz, m/s, and mm for the spherical cap of the array
+#define FREQUENCY_DEFAULT 1000000
+#define SOUND_SPEED_DEFAULT 1500
+#define RADIUS_DEFAULT 150
+#define APERTURE_DEFAULT 200
+#define PHASE_STEPS 256
+//  SteeringGrid, half widths around the natural focus and spacing in mm;
+//  the spacing has to stay well under a wavelength for the interpolation
+#define GRID_RANGE_XY 5
+#define GRID_RANGE_Z 5
+#define GRID_STEP 0.25
+//  points the table may hold, TRANSDUCER_COUNT bytes each; a larger grid
+//  is built with a coarser step
+#define GRID_POINTS_MAX 1048576
 //  FINISH
 
 #endif // CONSTANT
@@ -0,0 +1,65 @@
+#ifndef DEADLINE
+#define DEADLINE
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+#include "constant.h"
+
+//  Flag shared between a bulk operation and whoever may abort it
+//  (operator, watchdog). cancel() is safe to call from any thread.
+class CancelToken
+{
+public:
+    CancelToken() : m_canceled(0) {}
+
+    inline void cancel() { m_canceled.storeRelease(1); }
+    inline void reset() { m_canceled.storeRelease(0); }
+    inline bool isCanceled() const { return m_canceled.loadAcquire() != 0; }
+
+private:
+    QAtomicInt m_canceled;
+};
+
+//  Time budget of a bulk operation, started at construction.
+//  A negative timeout (DEADLINE_NONE) never expires.
+class Deadline
+{
+public:
+    Deadline(int timeout = DEADLINE_NONE, const CancelToken* token = 0)
+        : m_timeout(timeout), m_token(token)
+    {
+        m_timer.start();
+    }
+
+    inline bool expired() const
+    {
+        return m_timeout >= 0 && m_timer.elapsed() >= m_timeout;
+    }
+    inline bool canceled() const { return m_token != 0 && m_token->isCanceled(); }
+    //  polled between frames by the sweeps
+    inline bool reached() const { return canceled() || expired(); }
+
+    //  remaining milliseconds, DEADLINE_NONE if unbounded
+    inline int remaining() const
+    {
+        if (m_timeout < 0)
+            return DEADLINE_NONE;
+        qint64 left = m_timeout - m_timer.elapsed();
+        return left > 0 ? (int)left : 0;
+    }
+
+    //  shorten a blocking wait so that it never outlives the deadline
+    inline int clamp(int period) const
+    {
+        int left = remaining();
+        return (left == DEADLINE_NONE || left > period) ? period : left;
+    }
+
+private:
+    int m_timeout;
+    const CancelToken* m_token;
+    QElapsedTimer m_timer;
+};
+
+#endif // DEADLINE
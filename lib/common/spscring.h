@@ -0,0 +1,55 @@
+#ifndef SPSCRING
+#define SPSCRING
+
+#include <QAtomicInteger>
+
+#define CACHE_LINE 64
+
+//  Bounded lock-free queue for exactly one producer and one consumer thread.
+//  N must be a power of two; push() fails instead of blocking when full.
+//  Items are copied in place, nothing is allocated after construction.
+template <typename T, int N>
+class SpscRing
+{
+    Q_STATIC_ASSERT(N > 0 && (N & (N - 1)) == 0);
+
+public:
+    SpscRing() : m_head(0), m_tail(0) {}
+
+    //  producer side
+    bool push(const T& item)
+    {
+        quint32 head = m_head.load();
+        if (head - m_tail.loadAcquire() == (quint32)N)
+            return false;
+        m_items[head & (N - 1)] = item;
+        m_head.storeRelease(head + 1);
+        return true;
+    }
+
+    //  consumer side
+    bool pop(T& item)
+    {
+        quint32 tail = m_tail.load();
+        if (tail == m_head.loadAcquire())
+            return false;
+        item = m_items[tail & (N - 1)];
+        m_tail.storeRelease(tail + 1);
+        return true;
+    }
+
+    //  approximate when called from a third thread
+    inline int size() const { return (int)(m_head.loadAcquire() - m_tail.loadAcquire()); }
+    inline bool isEmpty() const { return size() == 0; }
+    inline int capacity() const { return N; }
+
+private:
+    //  head and tail on separate cache lines, each written by one side only
+    QAtomicInteger<quint32> m_head;
+    char m_padHead[CACHE_LINE - sizeof(QAtomicInteger<quint32>)];
+    QAtomicInteger<quint32> m_tail;
+    char m_padTail[CACHE_LINE - sizeof(QAtomicInteger<quint32>)];
+    T m_items[N];
+};
+
+#endif // SPSCRING